@@ -1,6 +1,8 @@
 #include <iostream>
 #include <vector>
 #include <string>
+#include <string_view>
+#include <new>
 #include <fstream>
 #include <sstream>
 #include <algorithm>
@@ -8,6 +10,77 @@
 #include <ctime>
 #include <iomanip>
 #include <memory>
+#include <atomic>
+#include <iterator>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cstdlib>
+#include <cctype>
+#include <stdexcept>
+#include <random>
+#include <unordered_map>
+#include <array>
+#include <tuple>
+#include <variant>
+#include <type_traits>
+#include <charconv>
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <cmath>
+#include <functional>
+#include <exception>
+#include <utility>
+
+// Partitioned mode runs shards as forked worker processes over Unix sockets;
+// notification delivery speaks SMTP over TCP
+#if defined(__unix__) || defined(__APPLE__)
+#define LMS_HAS_SHARDS 1
+#define LMS_HAS_SMTP 1
+#include <cerrno>
+#include <csignal>
+#include <fcntl.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#else
+#define LMS_HAS_SHARDS 0
+#define LMS_HAS_SMTP 0
+#endif
+
+// Build with -DLMS_COUNT_ALLOCATIONS=1 to count every global operator new,
+// so the simulator can check that query paths stay off the heap. Off by
+// default, leaving the standard allocator untouched.
+#ifndef LMS_COUNT_ALLOCATIONS
+#define LMS_COUNT_ALLOCATIONS 0
+#endif
+
+std::atomic<uint64_t> heapAllocationCount{0};
+
+#if LMS_COUNT_ALLOCATIONS
+void* operator new(std::size_t size) {
+    heapAllocationCount.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size == 0 ? 1 : size)) return p;
+    throw std::bad_alloc();
+}
+
+// Kept out of line so GCC does not pair the inlined free() with a
+// new-expression and warn about a mismatched deallocation.
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+void operator delete(void* p) noexcept { std::free(p); }
+
+void operator delete(void* p, std::size_t) noexcept { operator delete(p); }
+#endif
 
 // Forward declarations
 class Resource;
@@ -20,8 +93,19 @@ class Date {
 private:
     int day, month, year;
 
+    // Day number Date() returns instead of the wall clock, or -1
+    static std::atomic<int>& virtualToday() {
+        static std::atomic<int> dayNumber{-1};
+        return dayNumber;
+    }
+
 public:
     Date() {
+        int pinned = virtualToday().load(std::memory_order_relaxed);
+        if (pinned >= 0) {
+            *this = fromDayNumber(pinned);
+            return;
+        }
         time_t now = time(0);
         tm* ltm = localtime(&now);
         day = ltm->tm_mday;
@@ -32,20 +116,35 @@ public:
     Date(int d, int m, int y) : day(d), month(m), year(y) {}
 
     Date addDays(int days) const {
-        // Simplified date addition (for demonstration)
-        Date newDate = *this;
-        newDate.day += days;
-        if (newDate.day > 30) {
-            newDate.month += newDate.day / 30;
-            newDate.day = newDate.day % 30;
-            if (newDate.day == 0) newDate.day = 30;
-        }
-        if (newDate.month > 12) {
-            newDate.year += newDate.month / 12;
-            newDate.month = newDate.month % 12;
-            if (newDate.month == 0) newDate.month = 12;
-        }
-        return newDate;
+        return fromDayNumber(toDayNumber() + days);
+    }
+
+    // Days since 1/1/1970 on the Gregorian calendar, so dates survive a
+    // round trip through the archive unchanged
+    int toDayNumber() const {
+        int y = year - (month <= 2 ? 1 : 0);
+        int era = (y >= 0 ? y : y - 399) / 400;
+        int yearOfEra = y - era * 400;
+        int dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;  // from 1 March
+        int dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+        return era * 146097 + dayOfEra - 719468;
+    }
+
+    static Date fromDayNumber(int n) {
+        n += 719468;
+        int era = (n >= 0 ? n : n - 146096) / 146097;
+        int dayOfEra = n - era * 146097;
+        int yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+        int dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+        int shifted = (5 * dayOfYear + 2) / 153;  // month counted from March
+        int monthOfYear = shifted < 10 ? shifted + 3 : shifted - 9;
+        return Date(dayOfYear - (153 * shifted + 2) / 5 + 1, monthOfYear,
+                    yearOfEra + era * 400 + (monthOfYear <= 2 ? 1 : 0));
+    }
+
+    // Makes Date() return the given day (used by the simulator); -1 restores the wall clock
+    static void setVirtualToday(int dayNumber) {
+        virtualToday().store(dayNumber, std::memory_order_relaxed);
     }
 
     bool isOverdue(const Date& current) const {
@@ -65,312 +164,3462 @@ public:
     }
 };
 
-// Base Resource class
-class Resource {
-protected:
-    static int nextId;
-    int id;
-    std::string title;
-    std::string author;
-    int publicationYear;
-    std::string category;
-    bool isAvailable;
+// Compression for short catalog text: a table of up to 255 frequent
+// substrings of 1-8 bytes, one code byte per symbol and an escape byte
+// before any other byte (the FSST scheme). A table is immutable once
+// trained and counts the references held by the text encoded with it, so
+// it is freed with the last record that needs it.
+class SymbolTable {
+public:
+    static constexpr int MaxLength = 8;
+
+private:
+    static constexpr int MaxSymbols = 255;
+    static constexpr uint8_t Escape = 255;
+
+    char symbols[MaxSymbols][MaxLength] = {};
+    uint8_t lengths[MaxSymbols] = {};
+    int count = 0;
+    std::array<std::vector<uint8_t>, 256> byFirstByte;  // codes, longest symbol first
+    mutable std::atomic<size_t> references{0};
+
+    void add(const std::string& symbol) {
+        std::copy(symbol.begin(), symbol.end(), symbols[count]);
+        lengths[count] = static_cast<uint8_t>(symbol.size());
+        byFirstByte[static_cast<unsigned char>(symbol[0])].push_back(static_cast<uint8_t>(count));
+        ++count;
+    }
+
+    void index() {
+        for (auto& codes : byFirstByte) {
+            std::sort(codes.begin(), codes.end(), [this](uint8_t a, uint8_t b) { return lengths[a] > lengths[b]; });
+        }
+    }
+
+    // Longest symbol at the start of text, or -1
+    int match(std::string_view text) const {
+        for (uint8_t code : byFirstByte[static_cast<unsigned char>(text[0])]) {
+            if (lengths[code] <= text.size() && std::equal(symbols[code], symbols[code] + lengths[code], text.data())) {
+                return code;
+            }
+        }
+        return -1;
+    }
 
 public:
-    Resource(const std::string& t, const std::string& a, int year, const std::string& cat)
-        : id(nextId++), title(t), author(a), publicationYear(year), category(cat), isAvailable(true) {}
+    // Each round encodes the sample with the current table, counts the
+    // tokens it emits and every pair of adjacent tokens, and keeps the
+    // candidates that save the most bytes. The caller takes the first
+    // reference.
+    static const SymbolTable* train(const std::vector<std::string>& sample) {
+        auto table = std::make_unique<SymbolTable>();
+        for (int round = 0; round < 5; ++round) {
+            std::map<std::string, size_t> frequency;
+            for (const std::string& text : sample) {
+                std::string_view rest = text;
+                std::string_view previous;
+                while (!rest.empty()) {
+                    int code = table->match(rest);
+                    size_t length = code < 0 ? 1 : table->lengths[code];
+                    std::string_view token = rest.substr(0, length);
+                    ++frequency[std::string(token)];
+                    if (!previous.empty() && previous.size() + token.size() <= MaxLength) {
+                        ++frequency[std::string(previous.data(), previous.size() + token.size())];
+                    }
+                    previous = token;
+                    rest.remove_prefix(length);
+                }
+            }
 
-    virtual ~Resource() = default;
+            std::vector<std::pair<size_t, std::string>> candidates;
+            for (const auto& entry : frequency) {
+                candidates.push_back({entry.second * entry.first.size(), entry.first});
+            }
+            size_t keep = std::min<size_t>(MaxSymbols, candidates.size());
+            std::partial_sort(candidates.begin(), candidates.begin() + keep, candidates.end(),
+                              [](const auto& a, const auto& b) { return a.first != b.first ? a.first > b.first : a.second < b.second; });
 
-    // Getters
-    int getId() const { return id; }
-    std::string getTitle() const { return title; }
-    std::string getAuthor() const { return author; }
-    int getPublicationYear() const { return publicationYear; }
-    std::string getCategory() const { return category; }
-    bool getAvailability() const { return isAvailable; }
+            table = std::make_unique<SymbolTable>();
+            for (size_t i = 0; i < keep; ++i) table->add(candidates[i].second);
+            table->index();
+        }
+        return table.release();
+    }
 
-    // Setters
-    void setTitle(const std::string& t) { title = t; }
-    void setAuthor(const std::string& a) { author = a; }
-    void setPublicationYear(int year) { publicationYear = year; }
-    void setCategory(const std::string& cat) { category = cat; }
-    void setAvailability(bool available) { isAvailable = available; }
+    static void retain(const SymbolTable* table) {
+        if (table) table->references.fetch_add(1, std::memory_order_relaxed);
+    }
 
-    virtual std::string getType() const = 0;
-    virtual void displayInfo() const {
-        std::cout << "ID: " << id << ", Title: " << title << ", Author: " << author
-                  << ", Year: " << publicationYear << ", Category: " << category
-                  << ", Available: " << (isAvailable ? "Yes" : "No") << std::endl;
+    static void release(const SymbolTable* table) {
+        if (table && table->references.fetch_sub(1, std::memory_order_acq_rel) == 1) delete table;
     }
 
-    virtual std::string toCSV() const {
-        return std::to_string(id) + "," + getType() + "," + title + "," + author + "," +
-               std::to_string(publicationYear) + "," + category + "," + (isAvailable ? "1" : "0");
+    void encode(std::string_view text, std::string& out) const {
+        while (!text.empty()) {
+            int code = match(text);
+            if (code < 0) {
+                out.push_back(static_cast<char>(Escape));
+                out.push_back(text[0]);
+                text.remove_prefix(1);
+            } else {
+                out.push_back(static_cast<char>(code));
+                text.remove_prefix(lengths[code]);
+            }
+        }
+    }
+
+    // out must have room for MaxLength bytes past the decoded text:
+    // every symbol is copied as a whole 8-byte slot
+    void decode(const uint8_t* p, const uint8_t* end, char* out) const {
+        while (p < end) {
+            uint8_t code = *p++;
+            if (code == Escape) {
+                *out++ = static_cast<char>(*p++);
+            } else {
+                std::memcpy(out, symbols[code], MaxLength);
+                out += lengths[code];
+            }
+        }
     }
 };
 
-int Resource::nextId = 1;
+inline size_t putVarint(uint64_t value, uint8_t* out) {
+    size_t size = 0;
+    do {
+        out[size++] = static_cast<uint8_t>((value & 0x7F) | (value >= 0x80 ? 0x80 : 0));
+        value >>= 7;
+    } while (value != 0);
+    return size;
+}
 
-// Derived classes for different resource types
-class Book : public Resource {
-private:
-    std::string isbn;
-    int pages;
+inline uint64_t getVarint(const uint8_t*& p) {
+    uint64_t value = 0;
+    for (int shift = 0;; shift += 7) {
+        uint8_t byte = *p++;
+        value |= static_cast<uint64_t>(byte & 0x7F) << shift;
+        if (!(byte & 0x80)) return value;
+    }
+}
 
+// The text fields of one record, packed into a single heap block owned by
+// the record: the symbol table pointer (null when the text is raw), the
+// field count, a varint payload size per field and for compressed text the
+// decoded length, then the payloads back to back. Copies duplicate the
+// block, so text is freed with the record that holds it.
+class PackedText {
 public:
-    Book(const std::string& t, const std::string& a, int year, const std::string& cat, const std::string& i, int p)
-        : Resource(t, a, year, cat), isbn(i), pages(p) {}
+    static constexpr size_t MaxFields = 8;
 
-    std::string getType() const override { return "Book"; }
-    std::string getISBN() const { return isbn; }
-    int getPages() const { return pages; }
+private:
+    std::unique_ptr<uint8_t[]> block;
 
-    void displayInfo() const override {
-        Resource::displayInfo();
-        std::cout << "ISBN: " << isbn << ", Pages: " << pages << std::endl;
+    const SymbolTable* table() const {
+        const SymbolTable* symbols = nullptr;
+        if (block) std::memcpy(&symbols, block.get(), sizeof(symbols));
+        return symbols;
     }
 
-    std::string toCSV() const override {
-        return Resource::toCSV() + "," + isbn + "," + std::to_string(pages);
+    // Finds field slot; returns false when the block has no such field
+    bool locate(size_t slot, const uint8_t*& payload, size_t& size, size_t& length) const {
+        if (!block || slot >= block[sizeof(SymbolTable*)]) return false;
+        bool compressed = table() != nullptr;
+        const uint8_t* p = block.get() + sizeof(SymbolTable*);
+        size_t fields = *p++;
+        size_t offset = 0;
+        size = length = 0;
+        for (size_t i = 0; i < fields; ++i) {
+            size_t fieldSize = static_cast<size_t>(getVarint(p));
+            size_t fieldLength = compressed ? static_cast<size_t>(getVarint(p)) : fieldSize;
+            if (i < slot) offset += fieldSize;
+            if (i == slot) {
+                size = fieldSize;
+                length = fieldLength;
+            }
+        }
+        payload = p + offset;
+        return true;
     }
-};
 
-class Article : public Resource {
-private:
-    std::string journal;
-    int volume;
+    size_t blockSize() const {
+        if (!block) return 0;
+        bool compressed = table() != nullptr;
+        const uint8_t* p = block.get() + sizeof(SymbolTable*);
+        size_t fields = *p++;
+        size_t payload = 0;
+        for (size_t i = 0; i < fields; ++i) {
+            payload += static_cast<size_t>(getVarint(p));
+            if (compressed) getVarint(p);
+        }
+        return static_cast<size_t>(p - block.get()) + payload;
+    }
+
+    // Decodes every field into per-thread buffers
+    static std::array<std::string_view, MaxFields>& unpack(const PackedText& text, size_t& fields) {
+        thread_local std::array<std::string, MaxFields> buffers;
+        thread_local std::array<std::string_view, MaxFields> views;
+        fields = text.fieldCount();
+        for (size_t i = 0; i < fields; ++i) views[i] = text.get(i, buffers[i]);
+        return views;
+    }
 
 public:
-    Article(const std::string& t, const std::string& a, int year, const std::string& cat, const std::string& j, int v)
-        : Resource(t, a, year, cat), journal(j), volume(v) {}
+    PackedText() = default;
+
+    PackedText(const PackedText& other) {
+        size_t size = other.blockSize();
+        if (size == 0) return;
+        block = std::make_unique<uint8_t[]>(size);
+        std::memcpy(block.get(), other.block.get(), size);
+        SymbolTable::retain(table());
+    }
 
-    std::string getType() const override { return "Article"; }
-    std::string getJournal() const { return journal; }
-    int getVolume() const { return volume; }
+    PackedText(PackedText&& other) noexcept : block(std::move(other.block)) {}
 
-    void displayInfo() const override {
-        Resource::displayInfo();
-        std::cout << "Journal: " << journal << ", Volume: " << volume << std::endl;
+    PackedText& operator=(PackedText other) noexcept {
+        std::swap(block, other.block);
+        return *this;
     }
 
-    std::string toCSV() const override {
-        return Resource::toCSV() + "," + journal + "," + std::to_string(volume);
-    }
-};
+    ~PackedText() { SymbolTable::release(table()); }
 
-class Thesis : public Resource {
-private:
-    std::string degree;
-    std::string university;
+    size_t fieldCount() const { return block ? block[sizeof(SymbolTable*)] : 0; }
 
-public:
-    Thesis(const std::string& t, const std::string& a, int year, const std::string& cat, const std::string& d, const std::string& u)
-        : Resource(t, a, year, cat), degree(d), university(u) {}
+    // Bytes in the block, and the length of the text it holds
+    size_t storedSize() const { return blockSize(); }
 
-    std::string getType() const override { return "Thesis"; }
-    std::string getDegree() const { return degree; }
-    std::string getUniversity() const { return university; }
+    size_t textSize() const {
+        size_t total = 0;
+        const uint8_t* payload;
+        size_t size, length;
+        for (size_t i = 0; i < fieldCount(); ++i) {
+            if (locate(i, payload, size, length)) total += length;
+        }
+        return total;
+    }
 
-    void displayInfo() const override {
-        Resource::displayInfo();
-        std::cout << "Degree: " << degree << ", University: " << university << std::endl;
+    bool usesTable(const SymbolTable* symbols) const { return table() == symbols; }
+
+    // Raw text is viewed in place; compressed text is decoded into scratch,
+    // reusing its capacity. Missing fields are empty.
+    std::string_view get(size_t slot, std::string& scratch) const {
+        const uint8_t* payload;
+        size_t size, length;
+        if (!locate(slot, payload, size, length)) return std::string_view();
+        const SymbolTable* symbols = table();
+        if (!symbols) return std::string_view(reinterpret_cast<const char*>(payload), size);
+        scratch.resize(length + SymbolTable::MaxLength);
+        symbols->decode(payload, payload + size, &scratch[0]);
+        scratch.resize(length);
+        return scratch;
     }
 
-    std::string toCSV() const override {
-        return Resource::toCSV() + "," + degree + "," + university;
+    // Decodes only when the lengths match, which most rows of a scan do not
+    bool equals(size_t slot, std::string_view value, std::string& scratch) const {
+        const uint8_t* payload;
+        size_t size, length;
+        if (!locate(slot, payload, size, length)) return value.empty();
+        return length == value.size() && get(slot, scratch) == value;
     }
-};
 
-class DigitalContent : public Resource {
-private:
-    std::string format;
-    double fileSize; // in MB
+    // Replaces the block with fields encoded with symbols (raw when null).
+    // The fields may point into the current block.
+    void assign(const SymbolTable* symbols, const std::string_view* fields, size_t count) {
+        if (count > MaxFields) throw std::invalid_argument("Too many text fields");
+        thread_local std::string payload;
+        thread_local std::string encoded;
+        uint8_t header[sizeof(SymbolTable*) + 1 + MaxFields * 20];
+        std::memcpy(header, &symbols, sizeof(symbols));
+        size_t headerSize = sizeof(symbols);
+        header[headerSize++] = static_cast<uint8_t>(count);
+        payload.clear();
+        for (size_t i = 0; i < count; ++i) {
+            std::string_view bytes = fields[i];
+            if (symbols) {
+                encoded.clear();
+                symbols->encode(fields[i], encoded);
+                bytes = encoded;
+            }
+            headerSize += putVarint(bytes.size(), header + headerSize);
+            if (symbols) headerSize += putVarint(fields[i].size(), header + headerSize);
+            payload.append(bytes);
+        }
 
-public:
-    DigitalContent(const std::string& t, const std::string& a, int year, const std::string& cat, const std::string& f, double size)
-        : Resource(t, a, year, cat), format(f), fileSize(size) {}
+        auto replacement = std::make_unique<uint8_t[]>(headerSize + payload.size());
+        std::memcpy(replacement.get(), header, headerSize);
+        std::memcpy(replacement.get() + headerSize, payload.data(), payload.size());
+        SymbolTable::retain(symbols);
+        SymbolTable::release(table());
+        block = std::move(replacement);
+    }
 
-    std::string getType() const override { return "Digital"; }
-    std::string getFormat() const { return format; }
-    double getFileSize() const { return fileSize; }
+    void assign(const SymbolTable* symbols, std::initializer_list<std::string_view> fields) {
+        assign(symbols, fields.begin(), fields.size());
+    }
 
-    void displayInfo() const override {
-        Resource::displayInfo();
-        std::cout << "Format: " << format << ", Size: " << fileSize << " MB" << std::endl;
+    // Re-encodes with the current table, adding empty fields up to slot
+    void set(size_t slot, std::string_view value) {
+        if (slot >= MaxFields) throw std::invalid_argument("Too many text fields");
+        size_t fields;
+        std::array<std::string_view, MaxFields>& views = unpack(*this, fields);
+        for (size_t i = fields; i <= slot; ++i) views[i] = std::string_view();
+        views[slot] = value;
+        assign(table(), views.data(), std::max(fields, slot + 1));
     }
 
-    std::string toCSV() const override {
-        return Resource::toCSV() + "," + format + "," + std::to_string(fileSize);
+    // Re-encodes every field with symbols
+    void recode(const SymbolTable* symbols) {
+        if (usesTable(symbols)) return;
+        size_t fields;
+        std::array<std::string_view, MaxFields>& views = unpack(*this, fields);
+        assign(symbols, views.data(), fields);
     }
 };
 
-// User class
-class User {
+// Compresses the text of the records added to one library. The first
+// TrainingSample strings it sees are left raw and train its symbol table;
+// every later record is re-encoded with that table as it is added.
+class TextCompressor {
 private:
-    static int nextId;
-    int id;
-    std::string name;
-    std::string email;
-    std::string userType; // Student, Faculty, etc.
+    static constexpr size_t TrainingSample = 4096;
 
-public:
-    User(const std::string& n, const std::string& e, const std::string& type)
-        : id(nextId++), name(n), email(e), userType(type) {}
-
-    // Getters
-    int getId() const { return id; }
-    std::string getName() const { return name; }
-    std::string getEmail() const { return email; }
-    std::string getUserType() const { return userType; }
+    const SymbolTable* table = nullptr;
+    std::vector<std::string> sample;
 
-    void displayInfo() const {
-        std::cout << "User ID: " << id << ", Name: " << name << ", Email: " << email
-                  << ", Type: " << userType << std::endl;
+public:
+    TextCompressor() = default;
+    TextCompressor(const TextCompressor&) = delete;
+    TextCompressor& operator=(const TextCompressor&) = delete;
+    ~TextCompressor() { SymbolTable::release(table); }
+
+    // Table to encode with, or nullptr while still sampling
+    const SymbolTable* symbols() const { return table; }
+
+    void learn(std::string_view text) {
+        if (table || text.empty()) return;
+        sample.emplace_back(text);
+        if (sample.size() == TrainingSample) {
+            table = SymbolTable::train(sample);
+            SymbolTable::retain(table);
+            sample.clear();
+            sample.shrink_to_fit();
+        }
     }
 
-    std::string toCSV() const {
-        return std::to_string(id) + "," + name + "," + email + "," + userType;
+    void compress(PackedText& text) {
+        if (table) {
+            text.recode(table);
+            return;
+        }
+        std::string scratch;
+        for (size_t i = 0; i < text.fieldCount(); ++i) learn(text.get(i, scratch));
     }
 };
 
-int User::nextId = 1;
+// Compile-time resource schemas. Each resource type lists its fields as a
+// std::tuple of descriptors; the codecs and displayInfo() walk that tuple
+// with fold expressions, so a record is encoded field by field without a
+// virtual call or a temporary string per field.
+// int, bool and double members, passed by value
+template <typename Class, typename T>
+struct Field {
+    using Value = T;
+    const char* name;   // CSV header / JSON key
+    const char* label;  // displayInfo() label, nullptr to hide
+    T Class::* member;
+    const char* unit;
+
+    template <typename R>
+    Value read(const R& record) const { return record.*member; }
+
+    template <typename R>
+    void write(R& record, Value value) const { record.*member = value; }
+};
 
-// Loan class
-class Loan {
-private:
-    static int nextId;
-    int id;
-    int userId;
-    int resourceId;
-    Date borrowDate;
-    Date dueDate;
-    Date returnDate;
-    bool isReturned;
+template <typename Class, typename T>
+constexpr Field<Class, T> field(const char* name, const char* label, T Class::* member, const char* unit = "") {
+    return {name, label, member, unit};
+}
 
-public:
-    Loan(int uId, int rId, int loanDays = 14)
-        : id(nextId++), userId(uId), resourceId(rId), borrowDate(), isReturned(false) {
-        dueDate = borrowDate.addDays(loanDays);
-    }
+// Text field number slot of the record's PackedText, passed as a view
+struct TextField {
+    using Value = std::string_view;
+    const char* name;
+    const char* label;
+    size_t slot;
+    const char* unit;
 
-    // Getters
-    int getId() const { return id; }
-    int getUserId() const { return userId; }
-    int getResourceId() const { return resourceId; }
-    Date getBorrowDate() const { return borrowDate; }
-    Date getDueDate() const { return dueDate; }
-    bool getIsReturned() const { return isReturned; }
+    // The view stays valid until the next text field is read on this thread
+    template <typename R>
+    Value read(const R& record) const;
 
-    void returnResource() {
-        isReturned = true;
-        returnDate = Date();
-    }
+    template <typename R>
+    void write(R& record, Value value) const;
+};
 
-    bool isOverdue() const {
-        if (isReturned) return false;
-        return dueDate.isOverdue(Date());
-    }
+constexpr TextField textField(const char* name, const char* label, size_t slot) {
+    return {name, label, slot, ""};
+}
 
-    void extendDueDate(int days) {
-        dueDate = dueDate.addDays(days);
-    }
+// The resource type name ("Book", ...), which selects the std::variant alternative
+struct TypeField {
+    using Value = std::string_view;
+    const char* name;
+    const char* label;
+    const char* unit;
 
-    void displayInfo() const {
-        std::cout << "Loan ID: " << id << ", User ID: " << userId << ", Resource ID: " << resourceId
-                  << ", Borrow Date: " << borrowDate << ", Due Date: " << dueDate
-                  << ", Returned: " << (isReturned ? "Yes" : "No");
-        if (isOverdue() && !isReturned) std::cout << " (OVERDUE)";
-        std::cout << std::endl;
-    }
+    template <typename R>
+    Value read(const R&) const { return R::TypeName; }
 
-    std::string toCSV() const {
-        return std::to_string(id) + "," + std::to_string(userId) + "," + std::to_string(resourceId) + "," +
-               borrowDate.toString() + "," + dueDate.toString() + "," + (isReturned ? "1" : "0");
+    template <typename R>
+    void write(R&, Value value) const {
+        if (value != R::TypeName) throw std::invalid_argument("Record type mismatch: " + std::string(value));
     }
 };
 
-int Loan::nextId = 1;
+// Lets decoders start from an empty record of any resource type, and text
+// fields reach the record's packed text
+struct SchemaAccess {
+    template <typename R>
+    static R blank() { return R(); }
 
-// Reservation class
-class Reservation {
-private:
-    static int nextId;
-    int id;
-    int userId;
-    int resourceId;
-    Date reservationDate;
-    bool isActive;
+    template <typename R>
+    static const PackedText& text(const R& record) { return record.text; }
 
-public:
-    Reservation(int uId, int rId)
-        : id(nextId++), userId(uId), resourceId(rId), reservationDate(), isActive(true) {}
+    template <typename R>
+    static PackedText& text(R& record) { return record.text; }
+};
 
-    // Getters
-    int getId() const { return id; }
-    int getUserId() const { return userId; }
-    int getResourceId() const { return resourceId; }
-    Date getReservationDate() const { return reservationDate; }
-    bool getIsActive() const { return isActive; }
+template <typename R>
+std::string_view TextField::read(const R& record) const {
+    thread_local std::string scratch;
+    return SchemaAccess::text(record).get(slot, scratch);
+}
 
-    void deactivate() { isActive = false; }
+template <typename R>
+void TextField::write(R& record, std::string_view value) const {
+    SchemaAccess::text(record).set(slot, value);
+}
 
-    void displayInfo() const {
-        std::cout << "Reservation ID: " << id << ", User ID: " << userId << ", Resource ID: " << resourceId
-                  << ", Date: " << reservationDate << ", Active: " << (isActive ? "Yes" : "No") << std::endl;
+class Book;
+class Article;
+class Thesis;
+class DigitalContent;
+
+// Value representation of one resource, as produced by the decoders
+using ResourceRecord = std::variant<Book, Article, Thesis, DigitalContent>;
+
+// Appends a number in its shortest round-trip form
+template <typename T>
+void appendNumber(std::string& out, T value) {
+    char digits[32];
+    auto result = std::to_chars(digits, digits + sizeof(digits), value);
+    out.append(digits, result.ptr);
+}
+
+template <typename T>
+T parseValue(std::string_view text) {
+    if constexpr (std::is_same_v<T, std::string_view>) {
+        return text;
+    } else if constexpr (std::is_same_v<T, bool>) {
+        if (text == "1" || text == "true") return true;
+        if (text == "0" || text == "false") return false;
+        throw std::invalid_argument("Not a boolean: " + std::string(text));
+    } else {
+        T value{};
+        auto result = std::from_chars(text.data(), text.data() + text.size(), value);
+        if (result.ec != std::errc() || result.ptr != text.data() + text.size()) {
+            throw std::invalid_argument("Not a number: " + std::string(text));
+        }
+        return value;
     }
+}
 
-    std::string toCSV() const {
-        return std::to_string(id) + "," + std::to_string(userId) + "," + std::to_string(resourceId) + "," +
-               reservationDate.toString() + "," + (isActive ? "1" : "0");
+// RFC 4180 rows in schema order; fields holding a comma, quote or line
+// break are quoted. Booleans are written as 1/0.
+struct CsvCodec {
+    static void put(std::string& out, std::string_view text) {
+        bool plain = true;
+        for (char c : text) plain &= c != ',' && c != '"' && c != '\r' && c != '\n';
+        if (plain) {
+            out.append(text);
+            return;
+        }
+        out.push_back('"');
+        for (char c : text) {
+            if (c == '"') out.push_back('"');
+            out.push_back(c);
+        }
+        out.push_back('"');
+    }
+    static void put(std::string& out, bool value) { out.push_back(value ? '1' : '0'); }
+    static void put(std::string& out, int value) { appendNumber(out, value); }
+    static void put(std::string& out, double value) { appendNumber(out, value); }
+
+    template <typename R>
+    static void encode(const R& record, std::string& out) {
+        bool first = true;
+        std::apply([&](const auto&... fields) {
+            ((first ? void(first = false) : out.push_back(','), put(out, fields.read(record))), ...);
+        }, R::schema());
     }
+
+    static void encode(const ResourceRecord& record, std::string& out);
+    static ResourceRecord decode(std::string_view row);
 };
 
-int Reservation::nextId = 1;
+// Self-delimiting records: the variant index, then each field in schema
+// order. Integers are zigzag varints, booleans one byte, doubles their 8
+// bytes, text a varint length and the bytes. The type field is implied.
+struct BinaryCodec {
+    static void putVarint(std::string& out, uint64_t value) {
+        while (value >= 0x80) {
+            out.push_back(static_cast<char>((value & 0x7F) | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<char>(value));
+    }
+    static void put(std::string& out, std::string_view text) {
+        putVarint(out, text.size());
+        out.append(text);
+    }
+    static void put(std::string& out, bool value) { out.push_back(value ? 1 : 0); }
+    static void put(std::string& out, int value) {
+        putVarint(out, (static_cast<uint64_t>(static_cast<int64_t>(value)) << 1) ^ static_cast<uint64_t>(static_cast<int64_t>(value) >> 63));
+    }
+    static void put(std::string& out, double value) {
+        char bytes[sizeof(double)];
+        std::memcpy(bytes, &value, sizeof(double));
+        out.append(bytes, sizeof(double));
+    }
 
-// Notification class
-class Notification {
-private:
-    std::string message;
-    Date date;
-    std::string type; // "due", "available", "overdue", "new_acquisition"
+    template <typename R>
+    static void encode(const R& record, std::string& out) {
+        std::apply([&](const auto&... fields) {
+            (encodeField(out, record, fields), ...);
+        }, R::schema());
+    }
 
-public:
-    Notification(const std::string& msg, const std::string& t)
-        : message(msg), date(), type(t) {}
+    template <typename R, typename F>
+    static void encodeField(std::string& out, const R& record, const F& field) {
+        if constexpr (!std::is_same_v<F, TypeField>) put(out, field.read(record));
+    }
 
-    void display() const {
-        std::cout << "[" << date << "] " << type << ": " << message << std::endl;
+    static void encode(const ResourceRecord& record, std::string& out);
+    // Decodes the record starting at offset and moves offset past it
+    static ResourceRecord decode(std::string_view data, size_t& offset);
+};
+
+// One flat JSON object per record, keyed by field name
+struct JsonCodec {
+    static void put(std::string& out, std::string_view text) {
+        static const char hex[] = "0123456789abcdef";
+        out.push_back('"');
+        for (char c : text) {
+            unsigned char u = static_cast<unsigned char>(c);
+            if (c == '"' || c == '\\') {
+                out.push_back('\\');
+                out.push_back(c);
+            } else if (u < 0x20) {
+                out.append("\\u00");
+                out.push_back(hex[u >> 4]);
+                out.push_back(hex[u & 0xF]);
+            } else {
+                out.push_back(c);
+            }
+        }
+        out.push_back('"');
+    }
+    static void put(std::string& out, bool value) { out.append(value ? "true" : "false"); }
+    static void put(std::string& out, int value) { appendNumber(out, value); }
+    static void put(std::string& out, double value) { appendNumber(out, value); }
+
+    template <typename R>
+    static void encode(const R& record, std::string& out) {
+        bool first = true;
+        out.push_back('{');
+        std::apply([&](const auto&... fields) {
+            ((out.append(first ? "\"" : ",\""), first = false, out.append(fields.name), out.append("\":"),
+              put(out, fields.read(record))), ...);
+        }, R::schema());
+        out.push_back('}');
     }
 
-    std::string getMessage() const { return message; }
-    std::string getType() const { return type; }
+    static void encode(const ResourceRecord& record, std::string& out);
+    static ResourceRecord decode(std::string_view object);
 };
 
-// Library Management System class
-class LibraryManagementSystem {
-private:
-    std::vector<std::unique_ptr<Resource>> resources;
-    std::vector<std::unique_ptr<User>> users;
-    std::vector<std::unique_ptr<Loan>> loans;
-    std::vector<std::unique_ptr<Reservation>> reservations;
-    std::vector<Notification> notifications;
-    std::map<std::string, std::string> libraryEvents;
+// Base Resource class
+class Resource {
+    friend struct SchemaAccess;
 
 public:
-    LibraryManagementSystem() {
-        void loadData();
-        void initializeLibrarySchedule();
+    // Slots of the shared text fields; each type's own text follows
+    static constexpr size_t TitleText = 0, AuthorText = 1, CategoryText = 2, OwnText = 3;
+
+protected:
+    static int nextId;
+    int id;
+    int publicationYear;
+    PackedText text;
+    bool isAvailable;
+
+    // Blank record for decoders to fill in (does not consume an id)
+    Resource() : id(0), publicationYear(0), isAvailable(true) {}
+
+    // texts holds the title, author and category, then the type's own text
+    Resource(std::initializer_list<std::string_view> texts, int year)
+        : id(nextId++), publicationYear(year), isAvailable(true) {
+        text.assign(nullptr, texts);
     }
 
-    ~LibraryManagementSystem() {
-        void saveData();
+public:
+    virtual ~Resource() = default;
+
+    // Fields shared by every resource type, in CSV column order
+    static constexpr auto schema() {
+        return std::make_tuple(field("id", "ID", &Resource::id),
+                               TypeField{"type", nullptr, ""},
+                               textField("title", "Title", TitleText),
+                               textField("author", "Author", AuthorText),
+                               field("year", "Year", &Resource::publicationYear),
+                               textField("category", "Category", CategoryText),
+                               field("available", "Available", &Resource::isAvailable));
     }
 
-    // Resource Management
-    void addResource() {
-        std::string title, author, category;
-        int year, choice;
+    // The next resource created takes this id
+    static void setNextId(int id) { nextId = id; }
+
+    // Getters. Text is decoded into scratch, which stops allocating once
+    // it has grown; the view is valid until scratch is reused.
+    int getId() const { return id; }
+    std::string_view getTitle(std::string& scratch) const { return text.get(TitleText, scratch); }
+    std::string_view getAuthor(std::string& scratch) const { return text.get(AuthorText, scratch); }
+    int getPublicationYear() const { return publicationYear; }
+    std::string_view getCategory(std::string& scratch) const { return text.get(CategoryText, scratch); }
+    bool getAvailability() const { return isAvailable; }
+    const PackedText& getText() const { return text; }
+
+    // Setters
+    void setTitle(std::string_view t) { text.set(TitleText, t); }
+    void setAuthor(std::string_view a) { text.set(AuthorText, a); }
+    void setPublicationYear(int year) { publicationYear = year; }
+    void setCategory(std::string_view cat) { text.set(CategoryText, cat); }
+    void setAvailability(bool available) { isAvailable = available; }
+
+    // Re-encodes the text with the library's table as the row is added
+    void compressText(TextCompressor& compressor) { compressor.compress(text); }
+
+    virtual std::string_view getType() const = 0;
+    virtual std::unique_ptr<Resource> clone() const = 0;
+    virtual void displayInfo() const = 0;
+
+    // One virtual call per record; the fields are encoded statically
+    virtual void appendCsv(std::string& out) const = 0;
+    virtual void appendBinary(std::string& out) const = 0;
+    virtual void appendJson(std::string& out) const = 0;
+    virtual ResourceRecord toRecord() const = 0;
+
+    std::string toCSV() const {
+        std::string row;
+        appendCsv(row);
+        return row;
+    }
+};
+
+int Resource::nextId = 1;
+
+// Implements the Resource interface for Derived from Derived::schema()
+template <typename Derived>
+class SchemaResource : public Resource {
+private:
+    template <typename T>
+    static void show(T value) {
+        if constexpr (std::is_same_v<T, bool>) {
+            std::cout << (value ? "Yes" : "No");
+        } else {
+            std::cout << value;
+        }
+    }
+
+protected:
+    using Resource::Resource;
+    SchemaResource() = default;
+
+public:
+    std::string_view getType() const override { return Derived::TypeName; }
+
+    std::unique_ptr<Resource> clone() const override {
+        return std::make_unique<Derived>(static_cast<const Derived&>(*this));
+    }
+
+    // Shared fields on the first line, the type's own fields on the second
+    void displayInfo() const override {
+        const Derived& self = static_cast<const Derived&>(*this);
+        constexpr size_t sharedFields = std::tuple_size_v<decltype(Resource::schema())>;
+        size_t index = 0;
+        bool lineStart = true;
+        auto print = [&](const auto& field) {
+            if (index++ == sharedFields) {
+                std::cout << std::endl;
+                lineStart = true;
+            }
+            if (!field.label) return;
+            if (!lineStart) std::cout << ", ";
+            std::cout << field.label << ": ";
+            show(field.read(self));
+            std::cout << field.unit;
+            lineStart = false;
+        };
+        std::apply([&](const auto&... fields) {
+            (print(fields), ...);
+        }, Derived::schema());
+        std::cout << std::endl;
+    }
+
+    void appendCsv(std::string& out) const override { CsvCodec::encode(static_cast<const Derived&>(*this), out); }
+    void appendBinary(std::string& out) const override { BinaryCodec::encode(static_cast<const Derived&>(*this), out); }
+    void appendJson(std::string& out) const override { JsonCodec::encode(static_cast<const Derived&>(*this), out); }
+    ResourceRecord toRecord() const override;
+};
+
+// Derived classes for different resource types
+class Book : public SchemaResource<Book> {
+    friend struct SchemaAccess;
+
+private:
+    int pages = 0;
+
+    Book() = default;
+
+public:
+    static constexpr std::string_view TypeName = "Book";
+
+    static constexpr auto schema() {
+        return std::tuple_cat(Resource::schema(), std::make_tuple(textField("isbn", "ISBN", OwnText),
+                                                                  field("pages", "Pages", &Book::pages)));
+    }
+
+    Book(const std::string& t, const std::string& a, int year, const std::string& cat, const std::string& i, int p)
+        : SchemaResource({t, a, cat, i}, year), pages(p) {}
+
+    std::string_view getISBN(std::string& scratch) const { return text.get(OwnText, scratch); }
+    int getPages() const { return pages; }
+};
+
+class Article : public SchemaResource<Article> {
+    friend struct SchemaAccess;
+
+private:
+    int volume = 0;
+
+    Article() = default;
+
+public:
+    static constexpr std::string_view TypeName = "Article";
+
+    static constexpr auto schema() {
+        return std::tuple_cat(Resource::schema(), std::make_tuple(textField("journal", "Journal", OwnText),
+                                                                  field("volume", "Volume", &Article::volume)));
+    }
+
+    Article(const std::string& t, const std::string& a, int year, const std::string& cat, const std::string& j, int v)
+        : SchemaResource({t, a, cat, j}, year), volume(v) {}
+
+    std::string_view getJournal(std::string& scratch) const { return text.get(OwnText, scratch); }
+    int getVolume() const { return volume; }
+};
+
+class Thesis : public SchemaResource<Thesis> {
+    friend struct SchemaAccess;
+
+private:
+    Thesis() = default;
+
+public:
+    static constexpr std::string_view TypeName = "Thesis";
+
+    static constexpr auto schema() {
+        return std::tuple_cat(Resource::schema(), std::make_tuple(textField("degree", "Degree", OwnText),
+                                                                  textField("university", "University", OwnText + 1)));
+    }
+
+    Thesis(const std::string& t, const std::string& a, int year, const std::string& cat, const std::string& d, const std::string& u)
+        : SchemaResource({t, a, cat, d, u}, year) {}
+
+    std::string_view getDegree(std::string& scratch) const { return text.get(OwnText, scratch); }
+    std::string_view getUniversity(std::string& scratch) const { return text.get(OwnText + 1, scratch); }
+};
+
+class DigitalContent : public SchemaResource<DigitalContent> {
+    friend struct SchemaAccess;
+
+private:
+    double fileSize = 0; // in MB
+
+    DigitalContent() = default;
+
+public:
+    static constexpr std::string_view TypeName = "Digital";
+
+    static constexpr auto schema() {
+        return std::tuple_cat(Resource::schema(), std::make_tuple(textField("format", "Format", OwnText),
+                                                                  field("size_mb", "Size", &DigitalContent::fileSize, " MB")));
+    }
+
+    DigitalContent(const std::string& t, const std::string& a, int year, const std::string& cat, const std::string& f, double size)
+        : SchemaResource({t, a, cat, f}, year), fileSize(size) {}
+
+    std::string_view getFormat(std::string& scratch) const { return text.get(OwnText, scratch); }
+    double getFileSize() const { return fileSize; }
+};
+
+template <typename Derived>
+ResourceRecord SchemaResource<Derived>::toRecord() const {
+    return static_cast<const Derived&>(*this);
+}
+
+inline std::shared_ptr<Resource> makeResource(ResourceRecord&& record) {
+    return std::visit([](auto&& resource) -> std::shared_ptr<Resource> {
+        return std::make_shared<std::decay_t<decltype(resource)>>(std::move(resource));
+    }, std::move(record));
+}
+
+// Field values read by a decoder. Text is held as views into the input and
+// packed into the record in one block once every field is read.
+struct DecodedFields {
+    std::array<std::string_view, PackedText::MaxFields> text{};
+    size_t textCount = 0;
+
+    template <typename R, typename F>
+    void write(R& record, const F& field, typename F::Value value) {
+        if constexpr (std::is_same_v<F, TextField>) {
+            text[field.slot] = value;
+            textCount = std::max(textCount, field.slot + 1);
+        } else {
+            field.write(record, value);
+        }
+    }
+};
+
+// Builds a blank record of the alternative accepted by select, fills it and
+// returns it as a ResourceRecord
+template <size_t I = 0, typename Select, typename Fill>
+ResourceRecord buildRecord(const Select& select, const Fill& fill) {
+    if constexpr (I == std::variant_size_v<ResourceRecord>) {
+        throw std::invalid_argument("Unknown resource type");
+    } else {
+        using R = std::variant_alternative_t<I, ResourceRecord>;
+        if (!select(I, R::TypeName)) return buildRecord<I + 1>(select, fill);
+        R record = SchemaAccess::blank<R>();
+        DecodedFields decoded;
+        fill(record, decoded);
+        SchemaAccess::text(record).assign(nullptr, decoded.text.data(), decoded.textCount);
+        return record;
+    }
+}
+
+inline void CsvCodec::encode(const ResourceRecord& record, std::string& out) {
+    std::visit([&out](const auto& resource) { encode(resource, out); }, record);
+}
+
+inline ResourceRecord CsvCodec::decode(std::string_view row) {
+    // Quoted fields are unescaped into per-thread buffers
+    thread_local std::array<std::string, 16> unquoted;
+    std::array<std::string_view, 16> cells;
+    size_t count = 0;
+    size_t pos = 0;
+    while (true) {
+        if (count == cells.size()) throw std::invalid_argument("Too many CSV fields");
+        if (pos < row.size() && row[pos] == '"') {
+            std::string& text = unquoted[count];
+            text.clear();
+            for (++pos;; ++pos) {
+                if (pos >= row.size()) throw std::invalid_argument("Unterminated CSV quote");
+                if (row[pos] == '"') {
+                    if (pos + 1 < row.size() && row[pos + 1] == '"') {
+                        text.push_back('"');
+                        ++pos;
+                    } else {
+                        ++pos;
+                        break;
+                    }
+                } else {
+                    text.push_back(row[pos]);
+                }
+            }
+            cells[count++] = text;
+        } else {
+            size_t end = std::min(row.find(',', pos), row.size());
+            cells[count++] = row.substr(pos, end - pos);
+            pos = end;
+        }
+        if (pos >= row.size()) break;
+        if (row[pos] != ',') throw std::invalid_argument("Malformed CSV row");
+        ++pos;
+    }
+    if (count < 2) throw std::invalid_argument("Malformed CSV row");
+
+    return buildRecord([&](size_t, std::string_view type) { return type == cells[1]; }, [&](auto& record, DecodedFields& decoded) {
+        using R = std::decay_t<decltype(record)>;
+        if (count != std::tuple_size_v<decltype(R::schema())>) throw std::invalid_argument("Wrong number of CSV fields");
+        size_t i = 0;
+        std::apply([&](const auto&... fields) {
+            (decoded.write(record, fields, parseValue<typename std::decay_t<decltype(fields)>::Value>(cells[i++])), ...);
+        }, R::schema());
+    });
+}
+
+inline void BinaryCodec::encode(const ResourceRecord& record, std::string& out) {
+    out.push_back(static_cast<char>(record.index()));
+    std::visit([&out](const auto& resource) { encode(resource, out); }, record);
+}
+
+inline ResourceRecord BinaryCodec::decode(std::string_view data, size_t& offset) {
+    auto byte = [&]() -> uint8_t {
+        if (offset >= data.size()) throw std::invalid_argument("Truncated binary record");
+        return static_cast<uint8_t>(data[offset++]);
+    };
+    auto varint = [&]() {
+        uint64_t value = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t b = byte();
+            value |= static_cast<uint64_t>(b & 0x7F) << shift;
+            if (!(b & 0x80)) return value;
+        }
+        throw std::invalid_argument("Malformed binary varint");
+    };
+    auto get = [&](auto tag) -> decltype(tag) {
+        using T = decltype(tag);
+        if constexpr (std::is_same_v<T, std::string_view>) {
+            size_t size = static_cast<size_t>(varint());
+            if (size > data.size() - offset) throw std::invalid_argument("Truncated binary record");
+            std::string_view text = data.substr(offset, size);
+            offset += size;
+            return text;
+        } else if constexpr (std::is_same_v<T, bool>) {
+            return byte() != 0;
+        } else if constexpr (std::is_same_v<T, int>) {
+            uint64_t zigzag = varint();
+            return static_cast<int>(static_cast<int64_t>(zigzag >> 1) ^ -static_cast<int64_t>(zigzag & 1));
+        } else {
+            if (sizeof(double) > data.size() - offset) throw std::invalid_argument("Truncated binary record");
+            double value;
+            std::memcpy(&value, data.data() + offset, sizeof(double));
+            offset += sizeof(double);
+            return value;
+        }
+    };
+
+    size_t index = byte();
+    return buildRecord([index](size_t i, std::string_view) { return i == index; }, [&](auto& record, DecodedFields& decoded) {
+        using R = std::decay_t<decltype(record)>;
+        std::apply([&](const auto&... fields) {
+            ([&](const auto& field) {
+                using F = std::decay_t<decltype(field)>;
+                if constexpr (!std::is_same_v<F, TypeField>) decoded.write(record, field, get(typename F::Value{}));
+            }(fields), ...);
+        }, R::schema());
+    });
+}
+
+inline void JsonCodec::encode(const ResourceRecord& record, std::string& out) {
+    std::visit([&out](const auto& resource) { encode(resource, out); }, record);
+}
+
+inline ResourceRecord JsonCodec::decode(std::string_view object) {
+    // Escaped strings are unescaped into per-thread buffers
+    thread_local std::array<std::string, 16> unescaped;
+    std::array<std::pair<std::string_view, std::string_view>, 16> members;
+    size_t count = 0;
+    size_t pos = 0;
+
+    auto skipSpace = [&] { while (pos < object.size() && std::isspace(static_cast<unsigned char>(object[pos]))) ++pos; };
+    auto expect = [&](char c) {
+        skipSpace();
+        if (pos >= object.size() || object[pos] != c) throw std::invalid_argument("Malformed JSON record");
+        ++pos;
+    };
+    auto string = [&](std::string& text) -> std::string_view {
+        expect('"');
+        size_t start = pos;
+        while (pos < object.size() && object[pos] != '"' && object[pos] != '\\') ++pos;
+        if (pos < object.size() && object[pos] == '"') return object.substr(start, pos++ - start);
+        text.assign(object.data() + start, pos - start);
+        while (pos < object.size() && object[pos] != '"') {
+            char c = object[pos++];
+            if (c != '\\') {
+                text.push_back(c);
+                continue;
+            }
+            if (pos >= object.size()) break;
+            char escape = object[pos++];
+            switch (escape) {
+                case 'n': text.push_back('\n'); break;
+                case 't': text.push_back('\t'); break;
+                case 'r': text.push_back('\r'); break;
+                case 'b': text.push_back('\b'); break;
+                case 'f': text.push_back('\f'); break;
+                case 'u': {
+                    if (pos + 4 > object.size()) throw std::invalid_argument("Malformed JSON escape");
+                    unsigned code = 0;
+                    auto result = std::from_chars(object.data() + pos, object.data() + pos + 4, code, 16);
+                    if (result.ptr != object.data() + pos + 4) throw std::invalid_argument("Malformed JSON escape");
+                    pos += 4;
+                    if (code > 0x7F) throw std::invalid_argument("Only ASCII \\u escapes are supported");
+                    text.push_back(static_cast<char>(code));
+                    break;
+                }
+                default: text.push_back(escape); break;
+            }
+        }
+        expect('"');
+        return text;
+    };
+
+    expect('{');
+    skipSpace();
+    if (pos < object.size() && object[pos] == '}') throw std::invalid_argument("Empty JSON record");
+    while (true) {
+        if (count == members.size()) throw std::invalid_argument("Too many JSON members");
+        std::string key;
+        std::string_view name = string(key);
+        if (!key.empty()) throw std::invalid_argument("Escaped JSON keys are not supported");
+        expect(':');
+        skipSpace();
+        std::string_view value;
+        if (pos < object.size() && object[pos] == '"') {
+            value = string(unescaped[count]);
+        } else {
+            size_t start = pos;
+            while (pos < object.size() && object[pos] != ',' && object[pos] != '}' &&
+                   !std::isspace(static_cast<unsigned char>(object[pos]))) ++pos;
+            value = object.substr(start, pos - start);
+        }
+        members[count++] = {name, value};
+        skipSpace();
+        if (pos < object.size() && object[pos] == ',') {
+            ++pos;
+            continue;
+        }
+        expect('}');
+        break;
+    }
+
+    auto member = [&](const char* name) {
+        for (size_t i = 0; i < count; ++i) {
+            if (members[i].first == name) return members[i].second;
+        }
+        throw std::invalid_argument(std::string("Missing JSON member: ") + name);
+    };
+    std::string_view type = member("type");
+    return buildRecord([type](size_t, std::string_view name) { return name == type; }, [&](auto& record, DecodedFields& decoded) {
+        using R = std::decay_t<decltype(record)>;
+        std::apply([&](const auto&... fields) {
+            (decoded.write(record, fields, parseValue<typename std::decay_t<decltype(fields)>::Value>(member(fields.name))), ...);
+        }, R::schema());
+    });
+}
+
+// User class
+class User {
+private:
+    static int nextId;
+    int id;
+    std::string name;
+    std::string email;
+    std::string userType; // Student, Faculty, etc.
+
+public:
+    User(const std::string& n, const std::string& e, const std::string& type)
+        : id(nextId++), name(n), email(e), userType(type) {}
+
+    // Getters
+    int getId() const { return id; }
+    std::string_view getName() const { return name; }
+    std::string_view getEmail() const { return email; }
+    std::string_view getUserType() const { return userType; }
+
+    void displayInfo() const {
+        std::cout << "User ID: " << id << ", Name: " << name << ", Email: " << email
+                  << ", Type: " << userType << std::endl;
+    }
+
+    std::string toCSV() const {
+        return std::to_string(id) + "," + name + "," + email + "," + userType;
+    }
+};
+
+int User::nextId = 1;
+
+// Loan class
+class Loan {
+private:
+    static int nextId;
+    int id;
+    int userId;
+    int resourceId;
+    Date borrowDate;
+    Date dueDate;
+    Date returnDate;
+    bool isReturned;
+
+public:
+    Loan(int uId, int rId, int loanDays = 14)
+        : id(nextId++), userId(uId), resourceId(rId), borrowDate(), isReturned(false) {
+        dueDate = borrowDate.addDays(loanDays);
+    }
+
+    // Rebuilds a loan read back from the archive (does not consume a new id)
+    Loan(int loanId, int uId, int rId, const Date& borrowed, const Date& due, const Date& returned, bool returnedFlag)
+        : id(loanId), userId(uId), resourceId(rId), borrowDate(borrowed), dueDate(due),
+          returnDate(returned), isReturned(returnedFlag) {}
+
+    // Getters
+    int getId() const { return id; }
+    int getUserId() const { return userId; }
+    int getResourceId() const { return resourceId; }
+    Date getBorrowDate() const { return borrowDate; }
+    Date getDueDate() const { return dueDate; }
+    Date getReturnDate() const { return returnDate; }
+    bool getIsReturned() const { return isReturned; }
+
+    void returnResource() {
+        isReturned = true;
+        returnDate = Date();
+    }
+
+    bool isOverdue() const {
+        return isOverdue(Date());
+    }
+
+    bool isOverdue(const Date& today) const {
+        if (isReturned) return false;
+        return dueDate.isOverdue(today);
+    }
+
+    void extendDueDate(int days) {
+        dueDate = dueDate.addDays(days);
+    }
+
+    void displayInfo() const {
+        std::cout << "Loan ID: " << id << ", User ID: " << userId << ", Resource ID: " << resourceId
+                  << ", Borrow Date: " << borrowDate << ", Due Date: " << dueDate
+                  << ", Returned: " << (isReturned ? "Yes" : "No");
+        if (isOverdue() && !isReturned) std::cout << " (OVERDUE)";
+        std::cout << std::endl;
+    }
+
+    std::string toCSV() const {
+        return std::to_string(id) + "," + std::to_string(userId) + "," + std::to_string(resourceId) + "," +
+               borrowDate.toString() + "," + dueDate.toString() + "," + (isReturned ? "1" : "0");
+    }
+};
+
+int Loan::nextId = 1;
+
+// Reservation class
+class Reservation {
+private:
+    static int nextId;
+    int id;
+    int userId;
+    int resourceId;
+    Date reservationDate;
+    bool isActive;
+
+public:
+    Reservation(int uId, int rId)
+        : id(nextId++), userId(uId), resourceId(rId), reservationDate(), isActive(true) {}
+
+    // Rebuilds a reservation read back from the archive (does not consume a new id)
+    Reservation(int resId, int uId, int rId, const Date& date, bool active)
+        : id(resId), userId(uId), resourceId(rId), reservationDate(date), isActive(active) {}
+
+    // Getters
+    int getId() const { return id; }
+    int getUserId() const { return userId; }
+    int getResourceId() const { return resourceId; }
+    Date getReservationDate() const { return reservationDate; }
+    bool getIsActive() const { return isActive; }
+
+    void deactivate() { isActive = false; }
+
+    void displayInfo() const {
+        std::cout << "Reservation ID: " << id << ", User ID: " << userId << ", Resource ID: " << resourceId
+                  << ", Date: " << reservationDate << ", Active: " << (isActive ? "Yes" : "No") << std::endl;
+    }
+
+    std::string toCSV() const {
+        return std::to_string(id) + "," + std::to_string(userId) + "," + std::to_string(resourceId) + "," +
+               reservationDate.toString() + "," + (isActive ? "1" : "0");
+    }
+};
+
+int Reservation::nextId = 1;
+
+// Notification class
+class Notification {
+private:
+    std::string message;
+    Date date;
+    std::string type; // "due", "available", "overdue", "new_acquisition"
+
+public:
+    Notification(std::string msg, std::string t)
+        : message(std::move(msg)), date(), type(std::move(t)) {}
+
+    Notification(std::string msg, std::string t, const Date& d)
+        : message(std::move(msg)), date(d), type(std::move(t)) {}
+
+    void display() const {
+        std::cout << "[" << date << "] " << type << ": " << message << std::endl;
+    }
+
+    std::string_view getMessage() const { return message; }
+    const Date& getDate() const { return date; }
+    std::string_view getType() const { return type; }
+};
+
+// Every notification raised, oldest first. Entries are packed back to back
+// into 1 MB chunks: the day number, the type as an index into the distinct
+// types seen, and the message, compressed once the log has trained a symbol
+// table on its first messages. Notices mostly quote titles, so they shrink
+// like the catalog text does.
+class NotificationLog {
+private:
+    static constexpr int ChunkBits = 20;
+    static constexpr size_t ChunkSize = size_t(1) << ChunkBits;
+    static constexpr size_t MaxChunks = 4096;
+
+    std::vector<std::unique_ptr<uint8_t[]>> chunks;
+    std::vector<uint32_t> entries;  // chunk << ChunkBits | offset
+    size_t used = ChunkSize;        // bytes used in the newest chunk
+    std::vector<std::string> types;
+    TextCompressor compressor;
+    std::string encoded;
+
+public:
+    void append(const Notification& notice) {
+        std::string_view message = notice.getMessage();
+        compressor.learn(message);
+        const SymbolTable* symbols = compressor.symbols();
+        encoded.clear();
+        if (symbols) symbols->encode(message, encoded);
+        std::string_view payload = symbols ? std::string_view(encoded) : message;
+
+        size_t type = std::find(types.begin(), types.end(), notice.getType()) - types.begin();
+        if (type == types.size()) types.emplace_back(notice.getType());
+
+        uint8_t header[50];
+        size_t headerSize = putVarint(static_cast<uint32_t>(notice.getDate().toDayNumber()), header);
+        headerSize += putVarint(type, header + headerSize);
+        headerSize += putVarint((static_cast<uint64_t>(payload.size()) << 1) | (symbols ? 1 : 0), header + headerSize);
+        if (symbols) headerSize += putVarint(message.size(), header + headerSize);
+
+        size_t size = headerSize + payload.size();
+        if (size > ChunkSize) throw std::invalid_argument("Notification too long to log");
+        if (used + size > ChunkSize) {
+            if (chunks.size() == MaxChunks) throw std::length_error("Notification log is full");
+            chunks.push_back(std::make_unique<uint8_t[]>(ChunkSize));
+            used = 0;
+        }
+        uint8_t* p = chunks.back().get() + used;
+        std::memcpy(p, header, headerSize);
+        std::memcpy(p + headerSize, payload.data(), payload.size());
+        entries.push_back(static_cast<uint32_t>((chunks.size() - 1) << ChunkBits | used));
+        used += size;
+    }
+
+    Notification operator[](size_t i) const {
+        const uint8_t* p = chunks[entries[i] >> ChunkBits].get() + (entries[i] & (ChunkSize - 1));
+        Date date = Date::fromDayNumber(static_cast<int>(static_cast<uint32_t>(getVarint(p))));
+        const std::string& type = types[static_cast<size_t>(getVarint(p))];
+        uint64_t tag = getVarint(p);
+        size_t size = static_cast<size_t>(tag >> 1);
+        std::string message;
+        if (!(tag & 1)) {
+            message.assign(reinterpret_cast<const char*>(p), size);
+        } else {
+            size_t length = static_cast<size_t>(getVarint(p));
+            message.resize(length + SymbolTable::MaxLength);
+            compressor.symbols()->decode(p, p + size, &message[0]);
+            message.resize(length);
+        }
+        return Notification(std::move(message), type, date);
+    }
+
+    size_t size() const { return entries.size(); }
+    bool empty() const { return entries.empty(); }
+};
+
+// Canonical ISBN-13 digits for an ISBN-10 or ISBN-13 written with or without
+// hyphens and spaces. Throws std::invalid_argument when the checksum fails.
+inline std::string normalizeIsbn(std::string_view raw) {
+    std::string digits;
+    for (char c : raw) {
+        if (c == '-' || c == ' ') continue;
+        digits.push_back(static_cast<char>(std::toupper(static_cast<unsigned char>(c))));
+    }
+
+    auto isDigit = [](char c) { return c >= '0' && c <= '9'; };
+    auto isbn13Check = [](const std::string& twelve) {
+        int sum = 0;
+        for (size_t i = 0; i < 12; ++i) sum += (twelve[i] - '0') * (i % 2 ? 3 : 1);
+        return static_cast<char>('0' + (10 - sum % 10) % 10);
+    };
+
+    if (digits.size() == 10) {
+        int sum = 0;
+        for (size_t i = 0; i < 10; ++i) {
+            char c = digits[i];
+            int value;
+            if (isDigit(c)) value = c - '0';
+            else if (c == 'X' && i == 9) value = 10;
+            else throw std::invalid_argument("Invalid ISBN: " + std::string(raw));
+            sum += value * static_cast<int>(10 - i);
+        }
+        if (sum % 11 != 0) throw std::invalid_argument("Invalid ISBN checksum: " + std::string(raw));
+        std::string twelve = "978" + digits.substr(0, 9);
+        return twelve + isbn13Check(twelve);
+    }
+
+    if (digits.size() == 13 && std::all_of(digits.begin(), digits.end(), isDigit) &&
+        (digits.compare(0, 3, "978") == 0 || digits.compare(0, 3, "979") == 0)) {
+        if (isbn13Check(digits.substr(0, 12)) != digits[12]) {
+            throw std::invalid_argument("Invalid ISBN checksum: " + std::string(raw));
+        }
+        return digits;
+    }
+
+    throw std::invalid_argument("Invalid ISBN: " + std::string(raw));
+}
+
+// A canonical ISBN-13 as a number, the key of the ISBN index
+inline uint64_t isbnKey(std::string_view canonical) {
+    uint64_t key = 0;
+    std::from_chars(canonical.data(), canonical.data() + canonical.size(), key);
+    return key;
+}
+
+// Writes the email address trimmed and case-folded, as used for uniqueness
+// checks, into folded (reusing its capacity)
+inline void foldEmail(std::string_view email, std::string& folded) {
+    folded.clear();
+    size_t first = email.find_first_not_of(" \t");
+    if (first == std::string_view::npos) return;
+    size_t last = email.find_last_not_of(" \t");
+    for (char c : email.substr(first, last - first + 1)) {
+        folded.push_back(static_cast<char>(std::tolower(static_cast<unsigned char>(c))));
+    }
+}
+
+// Builds a notification message with a single allocation
+inline std::string concat(std::string_view prefix, std::string_view subject) {
+    std::string text;
+    text.reserve(prefix.size() + subject.size());
+    text.append(prefix).append(subject);
+    return text;
+}
+
+// Persistent array of leaves: a radix tree with Fanout children per node,
+// filled from the left, under the copy-on-write tables and cold tiers.
+// freeze() returns a read-only copy sharing every node. After that a write
+// copies only the nodes on the path to the leaf it changes, one per level,
+// so the cost of a write grows with log(n) rather than with n. Each node
+// records the epoch of the tree allowed to change it in place, and
+// freeze() moves the writer to a new epoch.
+template <typename Leaf>
+class ChunkTree {
+public:
+    static constexpr size_t Fanout = 32;
+
+private:
+    static constexpr int Shift = 5;
+
+    struct Node {
+        uint64_t epoch = 0;
+        int key = 0;  // key of the first leaf beneath, for ordered lookups
+        std::vector<std::shared_ptr<Node>> children;  // inner nodes
+        Leaf leaf;                                     // leaves
+    };
+
+    std::shared_ptr<Node> root;
+    int height = 0;  // levels of inner nodes above the leaves
+    size_t count = 0;
+    uint64_t epoch = nextEpoch();
+
+    static uint64_t nextEpoch() {
+        static std::atomic<uint64_t> epochs{0};
+        return epochs.fetch_add(1, std::memory_order_relaxed) + 1;
+    }
+
+    std::shared_ptr<Node> makeNode(int key) const {
+        auto node = std::make_shared<Node>();
+        node->epoch = epoch;
+        node->key = key;
+        return node;
+    }
+
+    Node& own(std::shared_ptr<Node>& slot) {
+        if (slot->epoch != epoch) {
+            slot = std::make_shared<Node>(*slot);
+            slot->epoch = epoch;
+        }
+        return *slot;
+    }
+
+    static size_t digit(size_t index, int level) { return (index >> (Shift * level)) & (Fanout - 1); }
+
+    const Node& leafNode(size_t index) const {
+        const Node* node = root.get();
+        for (int level = height - 1; level >= 0; --level) node = node->children[digit(index, level)].get();
+        return *node;
+    }
+
+    // Drops the last leaf beneath slot; returns true when slot is left empty
+    bool popLast(std::shared_ptr<Node>& slot, int levels) {
+        Node& node = own(slot);
+        if (levels == 1 || popLast(node.children.back(), levels - 1)) node.children.pop_back();
+        return node.children.empty();
+    }
+
+    template <typename Fn>
+    static void forEachLeaf(const std::shared_ptr<Node>& node, int levels, const Fn& fn) {
+        for (const auto& child : node->children) {
+            if (levels == 1) {
+                fn(child);
+            } else {
+                forEachLeaf(child, levels - 1, fn);
+            }
+        }
+    }
+
+public:
+    ChunkTree() = default;
+    ChunkTree(const ChunkTree&) = delete;
+    ChunkTree& operator=(const ChunkTree&) = delete;
+
+    ChunkTree(ChunkTree&& other) noexcept { *this = std::move(other); }
+
+    ChunkTree& operator=(ChunkTree&& other) noexcept {
+        root = std::move(other.root);
+        height = std::exchange(other.height, 0);
+        count = std::exchange(other.count, 0);
+        epoch = std::exchange(other.epoch, nextEpoch());
+        return *this;
+    }
+
+    size_t size() const { return count; }
+    const Leaf& operator[](size_t index) const { return leafNode(index).leaf; }
+
+    // The leaf, copied first if it is shared with a frozen version
+    Leaf& edit(size_t index) {
+        Node* node = &own(root);
+        for (int level = height - 1; level >= 0; --level) node = &own(node->children[digit(index, level)]);
+        return node->leaf;
+    }
+
+    // Appends an empty leaf with the given key and returns it
+    Leaf& push_back(int key) {
+        if (!root) {
+            root = makeNode(key);
+            height = 1;
+        } else if (count == size_t(1) << (Shift * height)) {
+            auto top = makeNode(root->key);
+            top->children.push_back(std::move(root));
+            root = std::move(top);
+            ++height;
+        }
+        Node* node = &own(root);
+        for (int level = height - 1; level >= 0; --level) {
+            size_t i = digit(count, level);
+            if (i == node->children.size()) node->children.push_back(makeNode(key));
+            node = &own(node->children[i]);
+        }
+        ++count;
+        return node->leaf;
+    }
+
+    void pop_back() {
+        popLast(root, height);
+        if (--count == 0) {
+            root.reset();
+            height = 0;
+            return;
+        }
+        while (height > 1 && root->children.size() == 1) {
+            std::shared_ptr<Node> child = root->children[0];
+            root = std::move(child);
+            --height;
+        }
+    }
+
+    // Index of the last leaf whose key is at most key, or size() if none is
+    size_t findLeaf(int key) const {
+        if (!root || key < root->key) return count;
+        const Node* node = root.get();
+        size_t index = 0;
+        for (int level = height - 1; level >= 0; --level) {
+            auto it = std::upper_bound(node->children.begin(), node->children.end(), key,
+                [](int k, const std::shared_ptr<Node>& child) { return k < child->key; });
+            index = (index << Shift) | static_cast<size_t>(it - node->children.begin() - 1);
+            node = it[-1].get();
+        }
+        return index;
+    }
+
+    // Rebuilds the inner nodes over the leaves for which keep(leaf) holds
+    template <typename Keep>
+    void filter(const Keep& keep) {
+        std::vector<std::shared_ptr<Node>> level;
+        if (root) {
+            forEachLeaf(root, height, [&](const std::shared_ptr<Node>& leaf) {
+                if (keep(leaf->leaf)) level.push_back(leaf);
+            });
+        }
+        count = level.size();
+        height = 0;
+        root.reset();
+        if (level.empty()) return;
+        do {
+            std::vector<std::shared_ptr<Node>> parents;
+            for (size_t i = 0; i < level.size(); i += Fanout) {
+                auto parent = makeNode(level[i]->key);
+                parent->children.assign(level.begin() + static_cast<std::ptrdiff_t>(i),
+                                        level.begin() + static_cast<std::ptrdiff_t>(std::min(i + Fanout, level.size())));
+                parents.push_back(std::move(parent));
+            }
+            level = std::move(parents);
+            ++height;
+        } while (level.size() > 1);
+        root = std::move(level[0]);
+    }
+
+    // Read-only copy sharing every node with this tree
+    ChunkTree freeze() {
+        ChunkTree view;
+        view.root = root;
+        view.height = height;
+        view.count = count;
+        epoch = nextEpoch();
+        return view;
+    }
+};
+
+// Append-only compressed storage for records that left the hot working set.
+// Each record is a fixed number of int fields stored as zigzag varint deltas
+// against the previous record. Records are packed into blocks of about
+// BlockBytes; every block restarts its delta base so it decodes on its own.
+// Blocks are shared between versions: freeze() hands out a read-only copy and
+// the next append copies only the partially filled tail and its path in the
+// block tree.
+template <size_t Fields>
+class ColdSegment {
+public:
+    using Record = std::array<int, Fields>;
+
+private:
+    static constexpr size_t BlockBytes = 4096;
+
+    struct Block {
+        std::vector<uint8_t> bytes;
+        size_t records = 0;
+    };
+
+    ChunkTree<Block> blocks;
+    Record last{};
+    size_t count = 0;
+
+    static void putVarint(std::vector<uint8_t>& out, int64_t value) {
+        uint64_t v = (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+        while (v >= 0x80) {
+            out.push_back(static_cast<uint8_t>(v | 0x80));
+            v >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(v));
+    }
+
+    static int64_t getVarint(const uint8_t*& p) {
+        uint64_t v = 0;
+        int shift = 0;
+        while (*p & 0x80) {
+            v |= static_cast<uint64_t>(*p++ & 0x7F) << shift;
+            shift += 7;
+        }
+        v |= static_cast<uint64_t>(*p++) << shift;
+        return static_cast<int64_t>(v >> 1) ^ -static_cast<int64_t>(v & 1);
+    }
+
+    Block& writableTail() {
+        if (blocks.size() == 0 || blocks[blocks.size() - 1].bytes.size() >= BlockBytes) {
+            Block& block = blocks.push_back(0);
+            block.bytes.reserve(BlockBytes + Fields * 5);
+            last = Record{};
+            return block;
+        }
+        Block& block = blocks.edit(blocks.size() - 1);
+        block.bytes.reserve(BlockBytes + Fields * 5);  // a tail copied from a frozen version
+        return block;
+    }
+
+public:
+    void append(const Record& record) {
+        Block& block = writableTail();
+        for (size_t f = 0; f < Fields; ++f) {
+            putVarint(block.bytes, static_cast<int64_t>(record[f]) - last[f]);
+        }
+        last = record;
+        ++block.records;
+        ++count;
+    }
+
+    // Read-only copy sharing every block with this segment
+    ColdSegment freeze() {
+        ColdSegment view;
+        view.blocks = blocks.freeze();
+        view.last = last;
+        view.count = count;
+        return view;
+    }
+
+    template <typename Fn>
+    void forEachInBlock(size_t b, Fn&& fn) const {
+        const Block& block = blocks[b];
+        const uint8_t* p = block.bytes.data();
+        Record current{};
+        for (size_t i = 0; i < block.records; ++i) {
+            for (size_t f = 0; f < Fields; ++f) {
+                current[f] = static_cast<int>(current[f] + getVarint(p));
+            }
+            fn(current);
+        }
+    }
+
+    template <typename Fn>
+    void forEach(Fn&& fn) const {
+        for (size_t b = 0; b < blocks.size(); ++b) {
+            forEachInBlock(b, fn);
+        }
+    }
+
+    size_t blockCount() const { return blocks.size(); }
+
+    size_t size() const { return count; }
+
+    size_t byteSize() const {
+        size_t total = 0;
+        for (size_t b = 0; b < blocks.size(); ++b) total += blocks[b].bytes.size();
+        return total;
+    }
+};
+
+// Private copy of a record about to be edited in a CowTable
+template <typename T>
+std::shared_ptr<T> copyRecord(const T& record) {
+    return std::make_shared<T>(record);
+}
+
+inline std::shared_ptr<Resource> copyRecord(const Resource& record) {
+    return record.clone();
+}
+
+// Copy-on-write table of records, split into chunks of up to ChunkRows rows
+// held in a ChunkTree. freeze() returns a read-only version sharing all
+// chunks; afterwards the first write to a chunk copies that chunk and its
+// path in the tree, and edited records are cloned, so frozen versions never
+// change under their readers. Ids are handed out in increasing order and
+// rows are only ever appended, so every table stays sorted by id and
+// findById() can search the tree by each chunk's first id. Chunks emptied by
+// erase() are dropped from the end at once and from the middle once they
+// make up half of the table. Readers take no lock. Writers are not
+// concurrent: a table has a single writer (its LibraryManagementSystem,
+// which the desks call in turn).
+template <typename T>
+class CowTable {
+public:
+    using Row = std::shared_ptr<const T>;
+    using Chunk = std::vector<Row>;
+
+private:
+    static constexpr size_t ChunkRows = 256;
+
+    ChunkTree<Chunk> chunks;
+    size_t rows = 0;
+    size_t emptyChunks = 0;  // emptied chunks before the last one
+    uint64_t writes = 0;     // tells iterators their cached chunk may have moved
+    bool modified = false;
+
+    Chunk& ownChunk(size_t c) {
+        ++writes;
+        modified = true;
+        return chunks.edit(c);
+    }
+
+    size_t nonEmptyFrom(size_t c) const {
+        while (c < chunks.size() && chunks[c].empty()) ++c;
+        return c;
+    }
+
+public:
+    class const_iterator {
+    private:
+        const CowTable* table;
+        size_t chunk, row;
+        mutable const Chunk* cached = nullptr;  // the chunk as of table->writes == seen
+        mutable uint64_t seen = 0;
+        friend class CowTable;
+
+        const Chunk& current() const {
+            if (!cached || seen != table->writes) {
+                cached = &table->chunks[chunk];
+                seen = table->writes;
+            }
+            return *cached;
+        }
+
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = Row;
+        using difference_type = std::ptrdiff_t;
+        using pointer = const Row*;
+        using reference = const Row&;
+
+        const_iterator(const CowTable* t, size_t c, size_t i) : table(t), chunk(c), row(i) {}
+
+        reference operator*() const { return current()[row]; }
+        pointer operator->() const { return &**this; }
+
+        const_iterator& operator++() {
+            if (++row >= current().size()) {
+                chunk = table->nonEmptyFrom(chunk + 1);
+                row = 0;
+                cached = nullptr;
+            }
+            return *this;
+        }
+
+        const_iterator operator++(int) {
+            const_iterator previous = *this;
+            ++*this;
+            return previous;
+        }
+
+        bool operator==(const const_iterator& other) const { return chunk == other.chunk && row == other.row; }
+        bool operator!=(const const_iterator& other) const { return !(*this == other); }
+    };
+
+    CowTable() = default;
+    CowTable(CowTable&&) = default;
+    CowTable& operator=(CowTable&&) = default;
+
+    const_iterator begin() const { return const_iterator(this, nonEmptyFrom(0), 0); }
+    const_iterator end() const { return const_iterator(this, chunks.size(), 0); }
+    size_t size() const { return rows; }
+    bool empty() const { return rows == 0; }
+    const Row& back() const { return chunks[chunks.size() - 1].back(); }
+    size_t chunkCount() const { return chunks.size(); }
+    const Chunk& chunk(size_t c) const { return chunks[c]; }
+
+    const_iterator findById(int id) const {
+        size_t c = chunks.findLeaf(id);
+        if (c == chunks.size()) return end();
+        const Chunk& rowsOf = chunks[c];
+        auto rowIt = std::lower_bound(rowsOf.begin(), rowsOf.end(), id,
+            [](const Row& row, int key) { return row->getId() < key; });
+        if (rowIt == rowsOf.end() || (*rowIt)->getId() != id) return end();
+        return const_iterator(this, c, static_cast<size_t>(rowIt - rowsOf.begin()));
+    }
+
+    void push_back(Row row) {
+        if (rows > 0 && row->getId() <= back()->getId()) {
+            throw std::invalid_argument("Rows must be appended in increasing id order");
+        }
+        if (chunks.size() == 0 || chunks[chunks.size() - 1].size() >= ChunkRows) {
+            ++writes;
+            modified = true;
+            Chunk& chunk = chunks.push_back(row->getId());
+            chunk.reserve(ChunkRows);
+            chunk.push_back(std::move(row));
+        } else {
+            Chunk& chunk = ownChunk(chunks.size() - 1);
+            chunk.reserve(ChunkRows);  // a chunk copied from a frozen version
+            chunk.push_back(std::move(row));
+        }
+        ++rows;
+    }
+
+    void erase(const_iterator it) {
+        Chunk& chunk = ownChunk(it.chunk);
+        chunk.erase(chunk.begin() + static_cast<std::ptrdiff_t>(it.row));
+        --rows;
+        if (!chunk.empty()) return;
+        Chunk().swap(chunk);
+        if (it.chunk + 1 < chunks.size()) {
+            if (++emptyChunks * 2 > chunks.size()) {
+                chunks.filter([](const Chunk& c) { return !c.empty(); });
+                emptyChunks = 0;
+            }
+            return;
+        }
+        chunks.pop_back();
+        while (chunks.size() > 0 && chunks[chunks.size() - 1].empty()) {
+            chunks.pop_back();
+            --emptyChunks;
+        }
+    }
+
+    // Replaces the row with a private copy and returns it for modification
+    T& edit(const_iterator it) {
+        Row& row = ownChunk(it.chunk)[it.row];
+        std::shared_ptr<T> copy = copyRecord(*row);
+        T& record = *copy;
+        row = std::move(copy);
+        return record;
+    }
+
+    bool isModified() const { return modified; }
+
+    // Read-only version sharing all chunks with this table
+    CowTable freeze() {
+        CowTable view;
+        view.chunks = chunks.freeze();
+        view.rows = rows;
+        view.emptyChunks = emptyChunks;
+        modified = false;
+        return view;
+    }
+};
+
+// Cold tiers for the circulation history
+using LoanArchive = ColdSegment<6>;        // id, user, resource, borrow day, due day, return day
+using ReservationArchive = ColdSegment<4>; // id, user, resource, reservation day
+
+// Work-stealing scheduler shared by the scan-based queries. parallelFor()
+// splits [0, count) into one contiguous range per lane; each lane takes items
+// from the front of its own range and, once it runs dry, steals the back half
+// of the fullest remaining range. The calling thread works as lane 0. The
+// first exception thrown by fn stops the remaining items and is rethrown
+// from parallelFor() once every lane has stopped.
+class WorkStealingPool {
+private:
+    struct Lane {
+        std::mutex mutex;
+        size_t next = 0;
+        size_t end = 0;
+    };
+
+    std::vector<std::thread> threads;
+    std::unique_ptr<Lane[]> lanes;
+    size_t laneCount;
+
+    std::mutex runMutex;  // one parallelFor at a time
+    std::mutex jobMutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    void (*jobFn)(const void*, size_t) = nullptr;
+    const void* jobContext = nullptr;
+    uint64_t generation = 0;
+    size_t running = 0;
+    bool stopping = false;
+    std::exception_ptr failure;    // first exception of the current job
+    std::atomic<bool> failed{false};
+
+    bool popFront(Lane& lane, size_t& item) {
+        std::lock_guard<std::mutex> lock(lane.mutex);
+        if (lane.next == lane.end) return false;
+        item = lane.next++;
+        return true;
+    }
+
+    bool steal(size_t self) {
+        size_t victim = laneCount;
+        size_t most = 0;
+        for (size_t i = 0; i < laneCount; ++i) {
+            if (i == self) continue;
+            std::lock_guard<std::mutex> lock(lanes[i].mutex);
+            if (lanes[i].end - lanes[i].next > most) {
+                most = lanes[i].end - lanes[i].next;
+                victim = i;
+            }
+        }
+        if (victim == laneCount) return false;
+
+        size_t from, to;
+        {
+            std::lock_guard<std::mutex> lock(lanes[victim].mutex);
+            size_t remaining = lanes[victim].end - lanes[victim].next;
+            if (remaining == 0) return true;  // raced with its owner, look again
+            to = lanes[victim].end;
+            from = to - (remaining + 1) / 2;
+            lanes[victim].end = from;
+        }
+        std::lock_guard<std::mutex> lock(lanes[self].mutex);
+        lanes[self].next = from;
+        lanes[self].end = to;
+        return true;
+    }
+
+    void runLane(size_t self) {
+        size_t item;
+        try {
+            do {
+                while (!failed.load(std::memory_order_relaxed) && popFront(lanes[self], item)) {
+                    jobFn(jobContext, item);
+                }
+            } while (!failed.load(std::memory_order_relaxed) && steal(self));
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            if (!failure) failure = std::current_exception();
+            failed.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    void workerLoop(size_t self) {
+        uint64_t seen = 0;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(jobMutex);
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+            }
+            runLane(self);
+            std::lock_guard<std::mutex> lock(jobMutex);
+            if (--running == 0) done.notify_one();
+        }
+    }
+
+public:
+    explicit WorkStealingPool(size_t workers = std::max(1u, std::thread::hardware_concurrency()) - 1)
+        : lanes(new Lane[workers + 1]), laneCount(workers + 1) {
+        for (size_t i = 1; i <= workers; ++i) {
+            threads.emplace_back(&WorkStealingPool::workerLoop, this, i);
+        }
+    }
+
+    ~WorkStealingPool() {
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& thread : threads) thread.join();
+    }
+
+    WorkStealingPool(const WorkStealingPool&) = delete;
+    WorkStealingPool& operator=(const WorkStealingPool&) = delete;
+
+    size_t concurrency() const { return laneCount; }
+
+    // Calls fn(i) for every i in [0, count) and returns once all calls finished
+    // or rethrows the first exception one of them threw
+    template <typename Fn>
+    void parallelFor(size_t count, const Fn& fn) {
+        if (count <= 1 || threads.empty()) {
+            for (size_t i = 0; i < count; ++i) fn(i);
+            return;
+        }
+
+        std::lock_guard<std::mutex> run(runMutex);
+        for (size_t i = 0; i < laneCount; ++i) {
+            std::lock_guard<std::mutex> lock(lanes[i].mutex);
+            lanes[i].next = count * i / laneCount;
+            lanes[i].end = count * (i + 1) / laneCount;
+        }
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            jobFn = [](const void* context, size_t item) { (*static_cast<const Fn*>(context))(item); };
+            jobContext = &fn;
+            running = threads.size();
+            failure = nullptr;
+            failed.store(false, std::memory_order_relaxed);
+            ++generation;
+        }
+        wake.notify_all();
+
+        runLane(0);
+
+        std::unique_lock<std::mutex> lock(jobMutex);
+        done.wait(lock, [&] { return running == 0; });
+        if (failure) {
+            std::exception_ptr error = std::move(failure);
+            failure = nullptr;
+            lock.unlock();
+            std::rethrow_exception(error);
+        }
+    }
+};
+
+// Log-linear latency histogram in the style of HdrHistogram: values below
+// 2^SubBits ns get exact buckets, larger values keep SubBits significant bits
+// (about 3% relative error). record() is two relaxed atomic increments, cheap
+// enough to leave on in production.
+class LatencyHistogram {
+public:
+    static constexpr int SubBits = 5;
+    static constexpr int MaxBits = 40;  // ~18 minutes; slower samples are clamped
+    static constexpr size_t BucketCount = static_cast<size_t>(MaxBits - SubBits + 1) << SubBits;
+
+private:
+    std::array<std::atomic<uint64_t>, BucketCount> buckets{};
+    std::atomic<uint64_t> totalNs{0};
+
+    static int highestBit(uint64_t v) {
+#if defined(__GNUC__)
+        return 63 - __builtin_clzll(v);
+#else
+        int bit = 0;
+        while (v >>= 1) ++bit;
+        return bit;
+#endif
+    }
+
+public:
+    static size_t bucketFor(uint64_t ns) {
+        if (ns < (1u << SubBits)) return static_cast<size_t>(ns);
+        int msb = highestBit(ns);
+        if (msb >= MaxBits) {
+            ns = (uint64_t(1) << MaxBits) - 1;
+            msb = MaxBits - 1;
+        }
+        return (static_cast<size_t>(msb - SubBits + 1) << SubBits) +
+               static_cast<size_t>((ns >> (msb - SubBits)) - (1u << SubBits));
+    }
+
+    static uint64_t bucketLowerBound(size_t bucket) {
+        size_t group = bucket >> SubBits;
+        uint64_t sub = bucket & ((1u << SubBits) - 1);
+        if (group == 0) return sub;
+        return ((uint64_t(1) << SubBits) + sub) << (group - 1);
+    }
+
+    static uint64_t bucketUpperBound(size_t bucket) { return bucketLowerBound(bucket + 1) - 1; }
+
+    void record(uint64_t ns) {
+        buckets[bucketFor(ns)].fetch_add(1, std::memory_order_relaxed);
+        totalNs.fetch_add(ns, std::memory_order_relaxed);
+    }
+
+    uint64_t bucketCount(size_t bucket) const { return buckets[bucket].load(std::memory_order_relaxed); }
+    uint64_t sumNs() const { return totalNs.load(std::memory_order_relaxed); }
+
+    uint64_t count() const {
+        uint64_t total = 0;
+        for (const auto& bucket : buckets) total += bucket.load(std::memory_order_relaxed);
+        return total;
+    }
+
+    // Upper bound of the bucket holding the q-th quantile (0 < q <= 1)
+    uint64_t percentile(double q) const {
+        uint64_t total = count();
+        if (total == 0) return 0;
+        uint64_t rank = static_cast<uint64_t>(q * total + 0.5);
+        if (rank == 0) rank = 1;
+        uint64_t seen = 0;
+        for (size_t b = 0; b < BucketCount; ++b) {
+            seen += bucketCount(b);
+            if (seen >= rank) return bucketUpperBound(b);
+        }
+        return bucketUpperBound(BucketCount - 1);
+    }
+};
+
+enum class Operation {
+    AddResource, EditResource, RemoveResource, SearchResources, FindByIsbn, DuplicateReport,
+    AddUser, ViewUsers, FindByEmail,
+    BorrowResource, ReturnResource, RenewResource, BorrowHistory,
+    AlsoBorrowed, ReserveResource, ViewReservations,
+    ViewNotifications, SendNotifications, CheckOverdue, ExportSnapshot,
+    Count
+};
+
+struct OperationStats {
+    LatencyHistogram latency;
+    std::atomic<uint64_t> succeeded{0};
+    std::atomic<uint64_t> failed{0};
+};
+
+// Per-operation latency and outcome counters for LibraryManagementSystem
+class LibraryMetrics {
+private:
+    std::array<OperationStats, static_cast<size_t>(Operation::Count)> operations;
+
+public:
+    using Gauges = std::vector<std::pair<const char*, size_t>>;
+
+    static const char* name(Operation op) {
+        static const char* const names[] = {
+            "add_resource", "edit_resource", "remove_resource", "search_resources", "find_by_isbn", "duplicate_report",
+            "add_user", "view_users", "find_by_email",
+            "borrow_resource", "return_resource", "renew_resource", "borrow_history",
+            "also_borrowed", "reserve_resource", "view_reservations",
+            "view_notifications", "send_notifications", "check_overdue", "export_snapshot"};
+        return names[static_cast<size_t>(op)];
+    }
+
+    OperationStats& operator[](Operation op) { return operations[static_cast<size_t>(op)]; }
+    const OperationStats& operator[](Operation op) const { return operations[static_cast<size_t>(op)]; }
+
+    void writeSummary(std::ostream& out, const Gauges& gauges) const {
+        out << std::left << std::setw(20) << "operation" << std::right
+            << std::setw(10) << "ok" << std::setw(10) << "failed"
+            << std::setw(12) << "mean us" << std::setw(12) << "p50 us"
+            << std::setw(12) << "p99 us" << std::setw(12) << "max us" << std::endl;
+        out << std::fixed << std::setprecision(2);
+        for (size_t i = 0; i < operations.size(); ++i) {
+            const OperationStats& stats = operations[i];
+            uint64_t calls = stats.latency.count();
+            if (calls == 0) continue;
+            out << std::left << std::setw(20) << name(static_cast<Operation>(i)) << std::right
+                << std::setw(10) << stats.succeeded.load(std::memory_order_relaxed)
+                << std::setw(10) << stats.failed.load(std::memory_order_relaxed)
+                << std::setw(12) << stats.latency.sumNs() / 1000.0 / calls
+                << std::setw(12) << stats.latency.percentile(0.50) / 1000.0
+                << std::setw(12) << stats.latency.percentile(0.99) / 1000.0
+                << std::setw(12) << stats.latency.percentile(1.0) / 1000.0 << std::endl;
+        }
+        out.unsetf(std::ios::floatfield);
+        out << std::setprecision(6);
+        for (const auto& gauge : gauges) {
+            out << gauge.first << ": " << gauge.second << std::endl;
+        }
+    }
+
+    // Prometheus text exposition format. The fine buckets are folded into
+    // decade boundaries from 1us to 10s to keep the series count small.
+    void writePrometheus(std::ostream& out, const Gauges& gauges) const {
+        static const uint64_t boundsNs[] = {1000, 10000, 100000, 1000000, 10000000, 100000000,
+                                            1000000000, 10000000000ULL};
+        static const char* const boundLabels[] = {"1e-06", "1e-05", "0.0001", "0.001", "0.01", "0.1", "1", "10"};
+
+        out << "# HELP library_operation_duration_seconds Latency of library operations.\n";
+        out << "# TYPE library_operation_duration_seconds histogram\n";
+        for (size_t i = 0; i < operations.size(); ++i) {
+            const LatencyHistogram& latency = operations[i].latency;
+            const char* op = name(static_cast<Operation>(i));
+            uint64_t cumulative = 0;
+            size_t bucket = 0;
+            for (size_t b = 0; b < sizeof(boundsNs) / sizeof(boundsNs[0]); ++b) {
+                for (; bucket < LatencyHistogram::BucketCount &&
+                       LatencyHistogram::bucketUpperBound(bucket) <= boundsNs[b]; ++bucket) {
+                    cumulative += latency.bucketCount(bucket);
+                }
+                out << "library_operation_duration_seconds_bucket{op=\"" << op << "\",le=\""
+                    << boundLabels[b] << "\"} " << cumulative << "\n";
+            }
+            out << "library_operation_duration_seconds_bucket{op=\"" << op << "\",le=\"+Inf\"} "
+                << latency.count() << "\n";
+            out << "library_operation_duration_seconds_sum{op=\"" << op << "\"} "
+                << latency.sumNs() / 1e9 << "\n";
+            out << "library_operation_duration_seconds_count{op=\"" << op << "\"} "
+                << latency.count() << "\n";
+        }
+
+        out << "# HELP library_operations_total Library operations by outcome.\n";
+        out << "# TYPE library_operations_total counter\n";
+        for (size_t i = 0; i < operations.size(); ++i) {
+            const char* op = name(static_cast<Operation>(i));
+            out << "library_operations_total{op=\"" << op << "\",result=\"success\"} "
+                << operations[i].succeeded.load(std::memory_order_relaxed) << "\n";
+            out << "library_operations_total{op=\"" << op << "\",result=\"failure\"} "
+                << operations[i].failed.load(std::memory_order_relaxed) << "\n";
+        }
+
+        out << "# HELP library_collection_size Number of records held in memory.\n";
+        out << "# TYPE library_collection_size gauge\n";
+        for (const auto& gauge : gauges) {
+            out << "library_collection_size{collection=\"" << gauge.first << "\"} " << gauge.second << "\n";
+        }
+    }
+};
+
+// Times one operation. It counts as failed unless succeed() is called, so an
+// exception or an early return is recorded as a failure.
+class OperationTimer {
+private:
+    OperationStats& stats;
+    std::chrono::steady_clock::time_point start;
+    bool ok = false;
+
+public:
+    explicit OperationTimer(OperationStats& s) : stats(s), start(std::chrono::steady_clock::now()) {}
+
+    OperationTimer(const OperationTimer&) = delete;
+    OperationTimer& operator=(const OperationTimer&) = delete;
+
+    void succeed() { ok = true; }
+
+    ~OperationTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - start;
+        stats.latency.record(static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+        (ok ? stats.succeeded : stats.failed).fetch_add(1, std::memory_order_relaxed);
+    }
+};
+
+// Scoped tracing of internal phases, dumped as Chrome Trace Event JSON for
+// chrome://tracing or Perfetto. Spans go into per-thread buffers; a root span
+// decides for its whole subtree whether the operation is sampled. Sampling is
+// off until LMS_TRACE_SAMPLE=n (one root operation in n) or setSampleRate()
+// turns it on. Build with -DLMS_TRACING=0 to compile every LMS_TRACE_SCOPE out.
+#ifndef LMS_TRACING
+#define LMS_TRACING 1
+#endif
+
+class Tracer {
+public:
+    struct Event {
+        const char* name;
+        uint64_t startNs;
+        uint64_t durationNs;
+    };
+
+private:
+    static constexpr size_t MaxEventsPerThread = 1 << 18;
+
+    struct ThreadBuffer {
+        std::mutex mutex;  // only contended while a dump is running
+        uint32_t tid = 0;
+        bool mainThread = false;
+        std::vector<Event> events;
+        uint64_t dropped = 0;
+    };
+
+    // Captured during static initialization, which runs on the main thread;
+    // tids follow the order threads first record and say nothing about it
+    static inline const std::thread::id mainThread = std::this_thread::get_id();
+
+    std::mutex registryMutex;
+    std::vector<std::shared_ptr<ThreadBuffer>> buffers;
+    std::atomic<uint32_t> sampleEvery{0};
+    const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+    Tracer() {
+        if (const char* rate = std::getenv("LMS_TRACE_SAMPLE")) {
+            sampleEvery.store(static_cast<uint32_t>(std::strtoul(rate, nullptr, 10)));
+        }
+    }
+
+    ThreadBuffer& threadBuffer() {
+        thread_local std::shared_ptr<ThreadBuffer> buffer;
+        if (!buffer) {
+            buffer = std::make_shared<ThreadBuffer>();
+            buffer->mainThread = std::this_thread::get_id() == mainThread;
+            std::lock_guard<std::mutex> lock(registryMutex);
+            buffer->tid = static_cast<uint32_t>(buffers.size() + 1);
+            buffers.push_back(buffer);
+        }
+        return *buffer;
+    }
+
+public:
+    static Tracer& instance() {
+        static Tracer tracer;
+        return tracer;
+    }
+
+    // Trace one root operation out of every n; 0 turns tracing off
+    void setSampleRate(uint32_t n) { sampleEvery.store(n, std::memory_order_relaxed); }
+    uint32_t sampleRate() const { return sampleEvery.load(std::memory_order_relaxed); }
+
+    bool sampleRoot() {
+        thread_local uint32_t roots = 0;
+        uint32_t n = sampleRate();
+        return n != 0 && roots++ % n == 0;
+    }
+
+    uint64_t now() const {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now() - epoch).count());
+    }
+
+    void record(const char* name, uint64_t startNs, uint64_t endNs) {
+        ThreadBuffer& buffer = threadBuffer();
+        std::lock_guard<std::mutex> lock(buffer.mutex);
+        if (buffer.events.size() >= MaxEventsPerThread) {
+            ++buffer.dropped;
+            return;
+        }
+        buffer.events.push_back({name, startNs, endNs - startNs});
+    }
+
+    void writeChromeTrace(std::ostream& out) {
+        std::lock_guard<std::mutex> registry(registryMutex);
+        out << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+        bool first = true;
+        out << std::fixed << std::setprecision(3);
+        for (const auto& buffer : buffers) {
+            std::lock_guard<std::mutex> lock(buffer->mutex);
+            out << (first ? "\n" : ",\n") << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":"
+                << buffer->tid << ",\"args\":{\"name\":\"" << (buffer->mainThread ? "main" : "worker")
+                << "\",\"dropped_events\":" << buffer->dropped << "}}";
+            first = false;
+            for (const Event& event : buffer->events) {
+                out << ",\n{\"name\":\"" << event.name << "\",\"cat\":\"library\",\"ph\":\"X\",\"ts\":"
+                    << event.startNs / 1000.0 << ",\"dur\":" << event.durationNs / 1000.0
+                    << ",\"pid\":1,\"tid\":" << buffer->tid << "}";
+            }
+        }
+        out << "\n]}\n";
+        out.unsetf(std::ios::floatfield);
+        out << std::setprecision(6);
+    }
+
+    size_t eventCount() {
+        std::lock_guard<std::mutex> registry(registryMutex);
+        size_t total = 0;
+        for (const auto& buffer : buffers) {
+            std::lock_guard<std::mutex> lock(buffer->mutex);
+            total += buffer->events.size();
+        }
+        return total;
+    }
+};
+
+// RAII span. The outermost span on a thread makes the sampling decision and
+// nested spans follow it; work handed to another thread continues the trace
+// with the (name, sampled) constructor.
+class TraceScope {
+private:
+    static bool& threadSampled() {
+        thread_local bool sampled = false;
+        return sampled;
+    }
+
+    static int& threadDepth() {
+        thread_local int depth = 0;
+        return depth;
+    }
+
+    const char* name;
+    uint64_t start = 0;
+    bool recording;
+    bool previousSampled;
+
+public:
+    explicit TraceScope(const char* spanName)
+        : TraceScope(spanName, threadDepth() == 0 ? Tracer::instance().sampleRoot() : threadSampled()) {}
+
+    TraceScope(const char* spanName, bool sampled)
+        : name(spanName), recording(sampled), previousSampled(threadSampled()) {
+        threadSampled() = sampled;
+        ++threadDepth();
+        if (recording) start = Tracer::instance().now();
+    }
+
+    ~TraceScope() {
+        if (recording) Tracer::instance().record(name, start, Tracer::instance().now());
+        --threadDepth();
+        threadSampled() = previousSampled;
+    }
+
+    TraceScope(const TraceScope&) = delete;
+    TraceScope& operator=(const TraceScope&) = delete;
+
+    // Whether the current thread is inside a sampled span
+    static bool active() { return threadDepth() > 0 && threadSampled(); }
+};
+
+#define LMS_TRACE_CONCAT_(a, b) a##b
+#define LMS_TRACE_CONCAT(a, b) LMS_TRACE_CONCAT_(a, b)
+#if LMS_TRACING
+#define LMS_TRACE_SCOPE(name) TraceScope LMS_TRACE_CONCAT(traceScope_, __LINE__)(name)
+#define LMS_TRACE_CONTINUE(name, sampled) TraceScope LMS_TRACE_CONCAT(traceScope_, __LINE__)(name, sampled)
+#define LMS_TRACE_ACTIVE() TraceScope::active()
+#else
+#define LMS_TRACE_SCOPE(name) ((void)0)
+#define LMS_TRACE_CONTINUE(name, sampled) ((void)(sampled))
+#define LMS_TRACE_ACTIVE() false
+#endif
+
+// Pending notices of one patron, delivered as a single message
+struct NotificationBatch {
+    int userId = 0;
+    std::string address;
+    std::vector<Notification> notices;
+};
+
+enum class DeliveryStatus {
+    Delivered,
+    TryLater,  // transient failure; the batch is retried with backoff
+    Rejected   // permanent failure; the notices are dropped
+};
+
+// Where delivered notifications go. send() runs on the delivery thread;
+// an exception counts as TryLater.
+class NotificationSink {
+public:
+    virtual ~NotificationSink() = default;
+    virtual DeliveryStatus send(const NotificationBatch& batch) = 0;
+};
+
+// Delivers notifications on a background thread, so the operations that
+// raise them only pay for an enqueue. The worker waits batchWindow after the
+// first arrival, groups what has queued by patron (at most maxBatch notices
+// per message) and sends through the sink no faster than sendsPerSecond.
+// A batch the sink cannot take yet is retried with exponential backoff and
+// dropped after maxAttempts.
+class NotificationDispatcher {
+public:
+    struct Config {
+        std::chrono::milliseconds batchWindow{50};
+        size_t maxBatch = 20;
+        double sendsPerSecond = 50;
+        double burst = 10;
+        int maxAttempts = 5;
+        std::chrono::milliseconds initialBackoff{100};
+        std::chrono::milliseconds maxBackoff{10000};
+    };
+
+    struct Counters {
+        uint64_t enqueued = 0;
+        uint64_t delivered = 0;
+        uint64_t dropped = 0;
+        uint64_t batches = 0;
+        uint64_t retries = 0;
+    };
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Queued {
+        int userId;
+        std::string address;
+        Notification notice;
+    };
+
+    struct Pending {
+        NotificationBatch batch;
+        int attempts = 0;
+        Clock::time_point notBefore;
+    };
+
+    Config config;
+    std::shared_ptr<NotificationSink> sink;
+    OperationStats& stats;
+    std::thread worker;
+    std::atomic<bool> running{false};
+
+    std::mutex mutex;
+    std::condition_variable wake;  // new notices, flush or stop
+    std::condition_variable idle;  // nothing queued, pending or in flight
+    std::vector<Queued> queue;
+    Clock::time_point firstQueued;
+    size_t pendingBatches = 0;     // owned by the worker, published under mutex
+    bool draining = false;         // the worker holds notices outside the queue
+    size_t flushers = 0;
+    bool stopping = false;
+
+    std::atomic<uint64_t> enqueued{0};
+    std::atomic<uint64_t> delivered{0};
+    std::atomic<uint64_t> dropped{0};
+    std::atomic<uint64_t> batches{0};
+    std::atomic<uint64_t> retries{0};
+
+    // Worker-only state
+    std::vector<Pending> pending;
+    double tokens = 0;
+    Clock::time_point refilled;
+    std::mt19937 jitter{12345};
+
+    // Blocks until the rate limit allows another send
+    void takeToken() {
+        Clock::time_point now = Clock::now();
+        tokens = std::min(config.burst, tokens + std::chrono::duration<double>(now - refilled).count() * config.sendsPerSecond);
+        refilled = now;
+        if (tokens < 1) {
+            std::this_thread::sleep_for(std::chrono::duration<double>((1 - tokens) / config.sendsPerSecond));
+            tokens = 1;
+            refilled = Clock::now();
+        }
+        tokens -= 1;
+    }
+
+    // Exponential backoff with equal jitter: half the delay is fixed, half random
+    Clock::duration backoff(int attempts) {
+        double delay = std::min(static_cast<double>(config.maxBackoff.count()),
+                                static_cast<double>(config.initialBackoff.count()) * std::ldexp(1.0, attempts - 1));
+        std::uniform_real_distribution<double> spread(0.5, 1.0);
+        return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double, std::milli>(delay * spread(jitter)));
+    }
+
+    void group(std::vector<Queued>& taken) {
+        // Only batches built from this drain are extended; retries keep their notices
+        std::unordered_map<int, size_t> open;
+        Clock::time_point now = Clock::now();
+        for (Queued& item : taken) {
+            auto it = open.find(item.userId);
+            if (it == open.end() || pending[it->second].batch.notices.size() >= config.maxBatch) {
+                pending.push_back({{item.userId, std::move(item.address), {}}, 0, now});
+                it = open.insert_or_assign(item.userId, pending.size() - 1).first;
+            }
+            pending[it->second].batch.notices.push_back(std::move(item.notice));
+        }
+        taken.clear();
+    }
+
+    // Sends every batch that is due and drops the resolved ones
+    void sendDue() {
+        Clock::time_point now = Clock::now();
+        size_t kept = 0;
+        for (size_t i = 0; i < pending.size(); ++i) {
+            Pending& p = pending[i];
+            bool resolved = false;
+            if (p.notBefore <= now) {
+                takeToken();
+                DeliveryStatus status = DeliveryStatus::TryLater;
+                {
+                    OperationTimer timer(stats);
+                    LMS_TRACE_SCOPE("send_notifications");
+                    try {
+                        status = sink->send(p.batch);
+                    } catch (const std::exception&) {
+                        status = DeliveryStatus::TryLater;
+                    }
+                    if (status == DeliveryStatus::Delivered) timer.succeed();
+                }
+                size_t count = p.batch.notices.size();
+                if (status == DeliveryStatus::Delivered) {
+                    delivered.fetch_add(count, std::memory_order_relaxed);
+                    batches.fetch_add(1, std::memory_order_relaxed);
+                    resolved = true;
+                } else if (status == DeliveryStatus::Rejected || ++p.attempts >= config.maxAttempts) {
+                    dropped.fetch_add(count, std::memory_order_relaxed);
+                    resolved = true;
+                } else {
+                    retries.fetch_add(1, std::memory_order_relaxed);
+                    p.notBefore = Clock::now() + backoff(p.attempts);
+                }
+            }
+            if (!resolved) {
+                if (kept != i) pending[kept] = std::move(p);
+                ++kept;
+            }
+        }
+        pending.erase(pending.begin() + static_cast<std::ptrdiff_t>(kept), pending.end());
+    }
+
+    void run() {
+        std::vector<Queued> taken;
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            if (queue.empty()) {
+                if (pending.empty()) {
+                    idle.notify_all();
+                    if (stopping) break;
+                    wake.wait(lock);
+                    continue;
+                }
+                Clock::time_point due = pending.front().notBefore;
+                for (const Pending& p : pending) due = std::min(due, p.notBefore);
+                if (due > Clock::now() && wake.wait_until(lock, due) == std::cv_status::no_timeout) continue;
+            } else if (!stopping && flushers == 0 && Clock::now() < firstQueued + config.batchWindow) {
+                // Let more notices for the same patrons arrive
+                wake.wait_until(lock, firstQueued + config.batchWindow);
+                continue;
+            }
+
+            taken.swap(queue);
+            draining = true;
+            lock.unlock();
+            group(taken);
+            sendDue();
+            lock.lock();
+            draining = false;
+            pendingBatches = pending.size();
+        }
+    }
+
+public:
+    explicit NotificationDispatcher(OperationStats& sendStats) : stats(sendStats) {}
+
+    NotificationDispatcher(const NotificationDispatcher&) = delete;
+    NotificationDispatcher& operator=(const NotificationDispatcher&) = delete;
+
+    ~NotificationDispatcher() { stop(); }
+
+    // Starts the worker; notices enqueued before this are not delivered
+    void start(std::shared_ptr<NotificationSink> target, const Config& settings) {
+        if (running.load()) throw std::logic_error("Notification delivery already started");
+        if (!target) throw std::invalid_argument("Notification sink is required");
+        if (settings.sendsPerSecond <= 0 || settings.maxBatch == 0 || settings.maxAttempts < 1) {
+            throw std::invalid_argument("Invalid notification delivery settings");
+        }
+        config = settings;
+        sink = std::move(target);
+        tokens = config.burst;
+        refilled = Clock::now();
+        stopping = false;
+        worker = std::thread([this] { run(); });
+        running.store(true);
+    }
+
+    bool enabled() const { return running.load(std::memory_order_relaxed); }
+
+    // The only cost on the calling operation: a copy and a locked push
+    void enqueue(int userId, std::string_view address, const Notification& notice) {
+        if (!enabled()) return;
+        bool wasEmpty;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            wasEmpty = queue.empty();
+            if (wasEmpty) firstQueued = Clock::now();
+            queue.push_back({userId, std::string(address), notice});
+            // Counted before the worker can take it, so enqueued never trails delivered
+            enqueued.fetch_add(1, std::memory_order_relaxed);
+        }
+        if (wasEmpty) wake.notify_one();
+    }
+
+    // Waits until every enqueued notice has been delivered or dropped,
+    // skipping the batch window but not the retry backoff
+    void flush() {
+        if (!enabled()) return;
+        std::unique_lock<std::mutex> lock(mutex);
+        ++flushers;
+        wake.notify_one();
+        idle.wait(lock, [this] { return queue.empty() && pendingBatches == 0 && !draining; });
+        --flushers;
+    }
+
+    // Delivers what is left, then joins the worker
+    void stop() {
+        if (!running.exchange(false)) return;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_one();
+        worker.join();
+    }
+
+    Counters counters() const {
+        return {enqueued.load(std::memory_order_relaxed), delivered.load(std::memory_order_relaxed),
+                dropped.load(std::memory_order_relaxed), batches.load(std::memory_order_relaxed),
+                retries.load(std::memory_order_relaxed)};
+    }
+};
+
+#if LMS_HAS_SMTP
+// Buffered CRLF line reading and writing on a connected socket, shared by
+// the SMTP client and the mock server. Errors and timeouts throw.
+class SmtpConnection {
+private:
+    int fd;
+    std::string buffer;
+
+#ifdef MSG_NOSIGNAL
+    static constexpr int SendFlags = MSG_NOSIGNAL;
+#else
+    static constexpr int SendFlags = 0;  // SO_NOSIGPIPE is set on the socket instead
+#endif
+
+public:
+    explicit SmtpConnection(int socket) : fd(socket) {
+#ifdef SO_NOSIGPIPE
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+        timeval timeout{5, 0};
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    }
+
+    SmtpConnection(const SmtpConnection&) = delete;
+    SmtpConnection& operator=(const SmtpConnection&) = delete;
+
+    ~SmtpConnection() { ::close(fd); }
+
+    void write(std::string_view data) {
+        while (!data.empty()) {
+            ssize_t n = ::send(fd, data.data(), data.size(), SendFlags);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) throw std::runtime_error("SMTP connection lost");
+            data.remove_prefix(static_cast<size_t>(n));
+        }
+    }
+
+    bool hasLine() const { return buffer.find("\r\n") != std::string::npos; }
+
+    // Next line without its CRLF; false on a clean close
+    bool readLine(std::string& line) {
+        while (true) {
+            size_t end = buffer.find("\r\n");
+            if (end != std::string::npos) {
+                line.assign(buffer, 0, end);
+                buffer.erase(0, end + 2);
+                return true;
+            }
+            if (buffer.size() > 65536) throw std::runtime_error("SMTP line too long");
+            char chunk[4096];
+            ssize_t n = ::recv(fd, chunk, sizeof(chunk), 0);
+            if (n < 0 && errno == EINTR) continue;
+            if (n == 0 && buffer.empty()) return false;
+            if (n <= 0) throw std::runtime_error("SMTP connection lost");
+            buffer.append(chunk, static_cast<size_t>(n));
+        }
+    }
+};
+
+// Delivers each batch as one email over a persistent SMTP connection,
+// reconnecting after an error. 4xx replies mean try later, 5xx rejection.
+class SmtpSink : public NotificationSink {
+private:
+    std::string host;
+    std::string port;
+    std::string sender;
+    std::unique_ptr<SmtpConnection> connection;
+    std::string line;
+    std::string message;
+
+    static constexpr std::chrono::seconds ConnectTimeout{5};  // across all of the host's addresses
+
+    // Connects without blocking past deadline; false on failure or timeout
+    static bool connectBy(int fd, const addrinfo& address, std::chrono::steady_clock::time_point deadline) {
+        int flags = fcntl(fd, F_GETFL, 0);
+        if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0) return false;
+        if (::connect(fd, address.ai_addr, address.ai_addrlen) != 0) {
+            if (errno != EINPROGRESS && errno != EINTR) return false;
+            pollfd p{fd, POLLOUT, 0};
+            while (true) {
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+                if (left.count() <= 0) return false;
+                int ready = ::poll(&p, 1, static_cast<int>(left.count()));
+                if (ready > 0) break;
+                if (ready == 0 || errno != EINTR) return false;
+            }
+            int error = 0;
+            socklen_t length = sizeof(error);
+            if (getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &length) != 0 || error != 0) return false;
+        }
+        return fcntl(fd, F_SETFL, flags) == 0;
+    }
+
+    // Reads a possibly multi-line reply and returns its code
+    int reply() {
+        do {
+            if (!connection->readLine(line)) throw std::runtime_error("SMTP server closed the connection");
+            if (line.size() < 3) throw std::runtime_error("Malformed SMTP reply");
+        } while (line.size() > 3 && line[3] == '-');
+        return std::atoi(line.substr(0, 3).c_str());
+    }
+
+    int command(const std::string& text) {
+        connection->write(text + "\r\n");
+        return reply();
+    }
+
+    void connect() {
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = SOCK_STREAM;
+        addrinfo* addresses = nullptr;
+        if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addresses) != 0) {
+            throw std::runtime_error("Cannot resolve SMTP host " + host);
+        }
+        int fd = -1;
+        auto deadline = std::chrono::steady_clock::now() + ConnectTimeout;
+        for (addrinfo* a = addresses; a && fd < 0; a = a->ai_next) {
+            fd = ::socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+            if (fd >= 0 && !connectBy(fd, *a, deadline)) {
+                ::close(fd);
+                fd = -1;
+            }
+        }
+        freeaddrinfo(addresses);
+        if (fd < 0) throw std::runtime_error("Cannot connect to SMTP server " + host + ":" + port);
+        connection = std::make_unique<SmtpConnection>(fd);
+        if (reply() != 220 || command("HELO library.local") != 250) {
+            connection.reset();
+            throw std::runtime_error("SMTP server refused the session");
+        }
+    }
+
+    static bool safeAddress(std::string_view address) {
+        return !address.empty() && address.find_first_of("<>\r\n ") == std::string_view::npos;
+    }
+
+    // Ends the transaction after a failed command; 4xx means try later
+    DeliveryStatus abort(int code) {
+        if (command("RSET") != 250) connection.reset();
+        return code / 100 == 4 ? DeliveryStatus::TryLater : DeliveryStatus::Rejected;
+    }
+
+public:
+    SmtpSink(std::string smtpHost, uint16_t smtpPort, std::string from)
+        : host(std::move(smtpHost)), port(std::to_string(smtpPort)), sender(std::move(from)) {}
+
+    ~SmtpSink() override {
+        if (!connection) return;
+        try {
+            command("QUIT");
+        } catch (const std::exception&) {
+        }
+    }
+
+    DeliveryStatus send(const NotificationBatch& batch) override {
+        if (!safeAddress(batch.address)) return DeliveryStatus::Rejected;
+        try {
+            if (!connection) connect();
+            int code = command("MAIL FROM:<" + sender + ">");
+            if (code != 250) return abort(code);
+            code = command("RCPT TO:<" + batch.address + ">");
+            if (code != 250 && code != 251) return abort(code);
+            code = command("DATA");
+            if (code != 354) return abort(code);
+
+            std::ostringstream body;
+            body << "From: <" << sender << ">\r\nTo: <" << batch.address << ">\r\n"
+                 << "Subject: Library notices (" << batch.notices.size() << ")\r\n\r\n";
+            for (const Notification& notice : batch.notices) {
+                // Every line starts with '[', so none needs dot-stuffing;
+                // line breaks inside a notice become spaces
+                std::string text(notice.getMessage());
+                std::replace(text.begin(), text.end(), '\r', ' ');
+                std::replace(text.begin(), text.end(), '\n', ' ');
+                body << "[" << notice.getDate() << "] " << notice.getType() << ": " << text << "\r\n";
+            }
+            // One write for the body and terminator, which avoids a
+            // Nagle/delayed-ACK stall between the two
+            body << ".\r\n";
+            message = body.str();
+            connection->write(message);
+            code = reply();
+            if (code == 250) return DeliveryStatus::Delivered;
+            return code / 100 == 4 ? DeliveryStatus::TryLater : DeliveryStatus::Rejected;
+        } catch (const std::runtime_error&) {
+            connection.reset();
+            return DeliveryStatus::TryLater;
+        }
+    }
+};
+
+// Minimal SMTP server on a loopback port for exercising delivery: it keeps
+// every accepted message and defers every failEvery-th transaction with a
+// 451 reply, so the retry path runs too. Connections are served one at a
+// time on the server thread.
+class MockSmtpServer {
+public:
+    struct Message {
+        std::string recipient;
+        std::string data;
+    };
+
+private:
+    int listener = -1;
+    uint16_t boundPort = 0;
+    unsigned failEvery;
+    unsigned transactions = 0;
+    std::atomic<bool> stopping{false};
+    std::thread server;
+    mutable std::mutex mutex;
+    std::vector<Message> received;
+
+    // Waits for fd to become readable, giving up when the server stops
+    bool waitReadable(int fd) {
+        pollfd p{fd, POLLIN, 0};
+        while (!stopping.load()) {
+            int ready = ::poll(&p, 1, 50);
+            if (ready > 0) return true;
+            if (ready < 0 && errno != EINTR) return false;
+        }
+        return false;
+    }
+
+    bool nextLine(SmtpConnection& connection, int fd, std::string& line) {
+        return (connection.hasLine() || waitReadable(fd)) && connection.readLine(line);
+    }
+
+    void serve(SmtpConnection& connection, int fd) {
+        std::string line;
+        std::string recipient;
+        bool sender = false;
+        connection.write("220 mock ESMTP ready\r\n");
+        while (nextLine(connection, fd, line)) {
+            std::string verb = line.substr(0, 4);
+            std::transform(verb.begin(), verb.end(), verb.begin(), [](unsigned char c) { return std::toupper(c); });
+            if (verb == "HELO" || verb == "EHLO" || verb == "NOOP") {
+                connection.write("250 mock\r\n");
+            } else if (verb == "MAIL") {
+                if (failEvery > 0 && ++transactions % failEvery == 0) {
+                    connection.write("451 Try again later\r\n");
+                } else {
+                    sender = true;
+                    connection.write("250 OK\r\n");
+                }
+            } else if (verb == "RCPT") {
+                size_t open = line.find('<');
+                size_t close = line.find('>', open);
+                if (!sender || open == std::string::npos || close == std::string::npos) {
+                    connection.write("503 Bad sequence of commands\r\n");
+                    continue;
+                }
+                recipient = line.substr(open + 1, close - open - 1);
+                connection.write("250 OK\r\n");
+            } else if (verb == "DATA") {
+                if (recipient.empty()) {
+                    connection.write("503 Bad sequence of commands\r\n");
+                    continue;
+                }
+                connection.write("354 End data with <CR><LF>.<CR><LF>\r\n");
+                std::string data;
+                while (true) {
+                    if (!nextLine(connection, fd, line)) return;
+                    if (line == ".") break;
+                    data.append(line.size() > 1 && line[0] == '.' ? line.substr(1) : line).append("\n");
+                }
+                {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    received.push_back({recipient, std::move(data)});
+                }
+                sender = false;
+                recipient.clear();
+                connection.write("250 Queued\r\n");
+            } else if (verb == "RSET") {
+                sender = false;
+                recipient.clear();
+                connection.write("250 OK\r\n");
+            } else if (verb == "QUIT") {
+                connection.write("221 Bye\r\n");
+                return;
+            } else {
+                connection.write("500 Unknown command\r\n");
+            }
+        }
+    }
+
+    void acceptLoop() {
+        while (waitReadable(listener)) {
+            int fd = ::accept(listener, nullptr, nullptr);
+            if (fd < 0) continue;
+            SmtpConnection connection(fd);
+            try {
+                serve(connection, fd);
+            } catch (const std::runtime_error&) {
+                // The client went away mid-session; take the next one
+            }
+        }
+    }
+
+public:
+    explicit MockSmtpServer(unsigned deferEvery = 0) : failEvery(deferEvery) {
+        listener = ::socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        socklen_t length = sizeof(address);
+        if (listener < 0 || ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 ||
+            ::listen(listener, 8) != 0 || ::getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length) != 0) {
+            if (listener >= 0) ::close(listener);
+            throw std::runtime_error("Cannot start mock SMTP server");
+        }
+        boundPort = ntohs(address.sin_port);
+        server = std::thread([this] { acceptLoop(); });
+    }
+
+    MockSmtpServer(const MockSmtpServer&) = delete;
+    MockSmtpServer& operator=(const MockSmtpServer&) = delete;
+
+    ~MockSmtpServer() {
+        stopping.store(true);
+        server.join();
+        ::close(listener);
+    }
+
+    uint16_t port() const { return boundPort; }
+
+    std::vector<Message> messages() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return received;
+    }
+};
+#endif
+
+// Consistent point-in-time view of the whole library. Report jobs pin one
+// with LibraryManagementSystem::pinSnapshot() and may read it from any thread
+// for as long as they hold it; its memory is released with the last holder.
+struct LibrarySnapshot {
+    uint64_t version = 0;
+    CowTable<Resource> resources;
+    CowTable<User> users;
+    CowTable<Loan> loans;
+    CowTable<Reservation> reservations;
+    LoanArchive loanArchive;
+    ReservationArchive reservationArchive;
+};
+
+// "Also borrowed" recommendations, maintained on every borrow. A borrow is
+// paired with the same user's last Window borrows from the past WindowDays,
+// and each resource keeps a fixed list of its TopK most co-borrowed
+// resources: a newcomer to a full list replaces the weakest entry and
+// inherits its score (Space-Saving). Scores halve every HalfLifeDays.
+// Replacement overestimates and decay leaves stale entries behind, so every
+// RebuildEvery borrows a background thread recomputes the lists exactly from
+// the recent loan history of a snapshot and swaps them in, replaying the
+// borrows that arrived while it ran.
+class CoBorrowIndex {
+public:
+    static constexpr size_t Window = 8;
+    static constexpr int WindowDays = 60;
+    static constexpr size_t TopK = 16;
+    static constexpr int HalfLifeDays = 90;
+    static constexpr size_t RebuildEvery = 20000;
+    static constexpr size_t MaxHistory = 1 << 18;          // newest borrows a rebuild reads
+    static constexpr int HistoryDays = 10 * HalfLifeDays;  // older borrows weigh under 1/1000
+    static constexpr size_t MergeEvery = 1 << 16;          // pairs buffered between merges
+
+    struct Recommendation {
+        int resourceId;
+        double score;
+    };
+
+private:
+    struct Entry {
+        int resourceId;
+        float score;
+        int day;  // day the score was last brought up to date
+    };
+
+    struct TopList {
+        std::array<Entry, TopK> entries;
+        uint8_t size = 0;
+    };
+
+    struct RecentBorrows {
+        std::array<std::pair<int, int>, Window> borrows;  // resource id, day
+        uint8_t size = 0;
+        uint8_t next = 0;
+    };
+
+    struct Borrow {
+        int userId;
+        int resourceId;
+        int day;
+    };
+
+    struct Tables {
+        std::unordered_map<int, TopList> lists;
+        std::unordered_map<int, RecentBorrows> recent;
+    };
+
+    Tables live;
+    std::vector<Borrow> pending;  // borrows since the running rebuild's snapshot
+    bool rebuilding = false;
+    size_t borrowsSinceRebuild = 0;
+    uint64_t rebuilds = 0;
+    std::thread worker;
+    mutable std::mutex mutex;
+
+    // Weight left after days of decay
+    static double decay(int days) {
+        static const std::array<float, 1024> table = [] {
+            std::array<float, 1024> t{};
+            for (size_t d = 0; d < t.size(); ++d) t[d] = static_cast<float>(std::exp2(-static_cast<double>(d) / HalfLifeDays));
+            return t;
+        }();
+        if (days <= 0) return 1;
+        return static_cast<size_t>(days) < table.size() ? table[days] : std::exp2(-static_cast<double>(days) / HalfLifeDays);
+    }
+
+    static void bump(TopList& list, int other, int day) {
+        for (uint8_t i = 0; i < list.size; ++i) {
+            Entry& entry = list.entries[i];
+            if (entry.resourceId == other) {
+                entry.score = static_cast<float>(entry.score * decay(day - entry.day) + 1);
+                entry.day = day;
+                return;
+            }
+        }
+        if (list.size < TopK) {
+            list.entries[list.size++] = {other, 1, day};
+            return;
+        }
+        Entry* weakest = &list.entries[0];
+        double weakestScore = weakest->score * decay(day - weakest->day);
+        for (Entry& entry : list.entries) {
+            double score = entry.score * decay(day - entry.day);
+            if (score < weakestScore) {
+                weakest = &entry;
+                weakestScore = score;
+            }
+        }
+        *weakest = {other, static_cast<float>(weakestScore + 1), day};
+    }
+
+    // Calls pair(a, b) for each earlier borrow a that b co-occurs with, then adds b to the window
+    template <typename Pair>
+    static void slide(RecentBorrows& recent, const Borrow& borrow, const Pair& pair) {
+        for (uint8_t i = 0; i < recent.size; ++i) {
+            const auto& earlier = recent.borrows[i];
+            if (earlier.first != borrow.resourceId && borrow.day - earlier.second <= WindowDays) {
+                pair(earlier.first, earlier.second);
+            }
+        }
+        recent.borrows[recent.next] = {borrow.resourceId, borrow.day};
+        recent.next = static_cast<uint8_t>((recent.next + 1) % Window);
+        if (recent.size < Window) ++recent.size;
+    }
+
+    static void apply(Tables& tables, const Borrow& borrow) {
+        slide(tables.recent[borrow.userId], borrow, [&](int other, int) {
+            bump(tables.lists[borrow.resourceId], other, borrow.day);
+            bump(tables.lists[other], borrow.resourceId, borrow.day);
+        });
+    }
+
+    // Keeps the TopK heaviest co-borrows, lower id first on equal weight
+    static void offer(TopList& list, int other, double weight, int today) {
+        Entry candidate{other, static_cast<float>(weight), today};
+        auto weaker = [](const Entry& a, const Entry& b) {
+            return a.score != b.score ? a.score < b.score : a.resourceId > b.resourceId;
+        };
+        if (list.size < TopK) {
+            list.entries[list.size++] = candidate;
+            return;
+        }
+        Entry* weakest = std::min_element(list.entries.begin(), list.entries.end(), weaker);
+        if (weaker(*weakest, candidate)) *weakest = candidate;
+    }
+
+    // Exact decayed co-borrow weights over the newest MaxHistory borrows of
+    // the past HistoryDays, cut to the top TopK per resource. Loans of
+    // removed resources are dropped. The history is trimmed as it is read
+    // and the pairs are merged in batches, so memory stays bounded by the
+    // cap rather than by the length of the loan history.
+    static Tables build(const LibrarySnapshot& snapshot, int today) {
+        using Dated = std::pair<int, Borrow>;  // loan id, borrow
+        auto newerFirst = [](const Dated& a, const Dated& b) {
+            return a.second.day != b.second.day ? a.second.day > b.second.day : a.first > b.first;
+        };
+        std::vector<Dated> history;
+        history.reserve(std::min(snapshot.loanArchive.size() + snapshot.loans.size(), 2 * MaxHistory));
+        auto trim = [&] {
+            if (history.size() <= MaxHistory) return;
+            std::nth_element(history.begin(), history.begin() + MaxHistory, history.end(), newerFirst);
+            history.resize(MaxHistory);
+        };
+        auto read = [&](int loanId, const Borrow& borrow) {
+            if (today - borrow.day > HistoryDays) return;
+            if (snapshot.resources.findById(borrow.resourceId) == snapshot.resources.end()) return;
+            history.push_back({loanId, borrow});
+            if (history.size() == 2 * MaxHistory) trim();
+        };
+        snapshot.loanArchive.forEach([&](const LoanArchive::Record& r) { read(r[0], {r[1], r[2], r[3]}); });
+        for (const auto& loan : snapshot.loans) {
+            read(loan->getId(), {loan->getUserId(), loan->getResourceId(), loan->getBorrowDate().toDayNumber()});
+        }
+        trim();
+        std::sort(history.begin(), history.end(), [&](const Dated& a, const Dated& b) { return newerFirst(b, a); });
+
+        // Every co-borrow as (lower id, higher id, weight); each batch is
+        // sorted and merged so a pair seen many times takes one slot
+        struct Pair {
+            int first;
+            int second;
+            double weight;
+        };
+        std::vector<Pair> pairs;
+        size_t mergeAt = MergeEvery;
+        auto merge = [&] {
+            std::sort(pairs.begin(), pairs.end(), [](const Pair& a, const Pair& b) {
+                return a.first != b.first ? a.first < b.first : a.second < b.second;
+            });
+            size_t kept = 0;
+            for (const Pair& pair : pairs) {
+                if (kept > 0 && pairs[kept - 1].first == pair.first && pairs[kept - 1].second == pair.second) {
+                    pairs[kept - 1].weight += pair.weight;
+                } else {
+                    pairs[kept++] = pair;
+                }
+            }
+            pairs.resize(kept);
+            mergeAt = std::max(MergeEvery, 2 * kept);
+        };
+
+        Tables tables;
+        for (const Dated& entry : history) {
+            const Borrow& borrow = entry.second;
+            double weight = decay(today - borrow.day);
+            slide(tables.recent[borrow.userId], borrow, [&](int other, int) {
+                pairs.push_back({std::min(borrow.resourceId, other), std::max(borrow.resourceId, other), weight});
+            });
+            if (pairs.size() >= mergeAt) merge();
+        }
+        merge();
+        history = std::vector<Dated>();
+
+        for (const Pair& pair : pairs) {
+            offer(tables.lists[pair.first], pair.second, pair.weight, today);
+            offer(tables.lists[pair.second], pair.first, pair.weight, today);
+        }
+        return tables;
+    }
+
+public:
+    CoBorrowIndex() = default;
+    CoBorrowIndex(const CoBorrowIndex&) = delete;
+    CoBorrowIndex& operator=(const CoBorrowIndex&) = delete;
+
+    ~CoBorrowIndex() {
+        if (worker.joinable()) worker.join();
+    }
+
+    // Returns true when a rebuild is due
+    bool recordBorrow(int userId, int resourceId, int day) {
+        std::lock_guard<std::mutex> lock(mutex);
+        Borrow borrow{userId, resourceId, day};
+        apply(live, borrow);
+        if (rebuilding) pending.push_back(borrow);
+        return ++borrowsSinceRebuild >= RebuildEvery && !rebuilding;
+    }
+
+    // Rebuilds from snapshot on a background thread. The snapshot must
+    // include every borrow recorded so far.
+    void startRebuild(std::shared_ptr<const LibrarySnapshot> snapshot, int today) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (rebuilding) return;
+        if (worker.joinable()) worker.join();  // the previous rebuild has already swapped in
+        rebuilding = true;
+        borrowsSinceRebuild = 0;
+        worker = std::thread([this, snapshot, today] {
+            Tables fresh = build(*snapshot, today);
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const Borrow& borrow : pending) apply(fresh, borrow);
+            live = std::move(fresh);
+            pending.clear();
+            rebuilding = false;
+            ++rebuilds;
+        });
+    }
+
+    // Fills out (reusing its capacity) with up to k resources, best first
+    void alsoBorrowed(int resourceId, int today, size_t k, std::vector<Recommendation>& out) const {
+        out.clear();
+        std::lock_guard<std::mutex> lock(mutex);
+        auto list = live.lists.find(resourceId);
+        if (list == live.lists.end()) return;
+        for (uint8_t i = 0; i < list->second.size; ++i) {
+            const Entry& entry = list->second.entries[i];
+            out.push_back({entry.resourceId, entry.score * decay(today - entry.day)});
+        }
+        std::sort(out.begin(), out.end(), [](const Recommendation& a, const Recommendation& b) {
+            return a.score != b.score ? a.score > b.score : a.resourceId < b.resourceId;
+        });
+        if (out.size() > k) out.resize(k);
+    }
+
+    size_t entryCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t total = 0;
+        for (const auto& list : live.lists) total += list.second.size;
+        return total;
+    }
+
+    uint64_t rebuildCount() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return rebuilds;
+    }
+};
+
+// Library Management System class
+class LibraryManagementSystem {
+private:
+    CowTable<Resource> resources;
+    CowTable<User> users;
+    CowTable<Loan> loans;
+    CowTable<Reservation> reservations;
+    NotificationLog notifications;
+    std::map<std::string, std::string> libraryEvents;
+
+    // Resource text is compressed with this library's table as rows are
+    // added; the gauges track what the rows hold
+    TextCompressor textCompressor;
+    size_t textBytes = 0;
+    size_t textStoredBytes = 0;
+    std::string textScratch;  // titles decoded by the writing operations
+
+    // Returned loans and inactive reservations are moved out of the vectors
+    // above, which only hold active circulation.
+    LoanArchive loanArchive;
+    ReservationArchive reservationArchive;
+
+    void archiveLoan(CowTable<Loan>::const_iterator it) {
+        LMS_TRACE_SCOPE("archive_loan");
+        const Loan& loan = **it;
+        loanArchive.append({loan.getId(), loan.getUserId(), loan.getResourceId(),
+                            loan.getBorrowDate().toDayNumber(), loan.getDueDate().toDayNumber(),
+                            loan.getReturnDate().toDayNumber()});
+        overdueNotified.erase(loan.getId());
+        loans.erase(it);
+    }
+
+    void archiveReservation(CowTable<Reservation>::const_iterator it) {
+        LMS_TRACE_SCOPE("archive_reservation");
+        const Reservation& reservation = **it;
+        reservationArchive.append({reservation.getId(), reservation.getUserId(), reservation.getResourceId(),
+                                   reservation.getReservationDate().toDayNumber()});
+        reservations.erase(it);
+    }
+
+    // Loan id -> due day its overdue notice was sent for: a patron hears once
+    // per overdue loan, and again only if a renewal moved the due date
+    std::unordered_map<int, int> overdueNotified;
+
+    // Latest committed version, replaced atomically by commit()
+    std::shared_ptr<const LibrarySnapshot> published;
+    uint64_t version = 0;
+
+    // Publishes the current state as a new snapshot if anything changed
+    void commit() {
+        LMS_TRACE_SCOPE("commit");
+        if (published && !resources.isModified() && !users.isModified() &&
+            !loans.isModified() && !reservations.isModified()) {
+            return;
+        }
+        auto snapshot = std::make_shared<LibrarySnapshot>();
+        snapshot->version = ++version;
+        snapshot->resources = resources.freeze();
+        snapshot->users = users.freeze();
+        snapshot->loans = loans.freeze();
+        snapshot->reservations = reservations.freeze();
+        snapshot->loanArchive = loanArchive.freeze();
+        snapshot->reservationArchive = reservationArchive.freeze();
+        std::atomic_store(&published, std::shared_ptr<const LibrarySnapshot>(std::move(snapshot)));
+    }
+
+    // Unique secondary indexes: canonical ISBN-13 (as a number) -> resource id,
+    // folded email -> user id
+    std::unordered_map<uint64_t, int> isbnIndex;
+    std::unordered_map<std::string, int> emailIndex;
+
+    CoBorrowIndex coBorrow;
+    std::unique_ptr<WorkStealingPool> pool = std::make_unique<WorkStealingPool>();
+    LibraryMetrics metrics;
+    NotificationDispatcher delivery{metrics[Operation::SendNotifications]};
+    std::ostream* console = &std::cout;  // messages printed from inside operations
+
+    CowTable<Resource>::const_iterator findResource(int id) const {
+        LMS_TRACE_SCOPE("find_resource");
+        return resources.findById(id);
+    }
+
+    CowTable<User>::const_iterator findUser(int id) const {
+        LMS_TRACE_SCOPE("find_user");
+        return users.findById(id);
+    }
+
+    CowTable<Loan>::const_iterator findLoan(int id) const {
+        LMS_TRACE_SCOPE("find_loan");
+        return loans.findById(id);
+    }
+
+    // Runs match(row, out) over every row of table as parallel per-chunk tasks.
+    // Each chunk fills its own buffer; buffers are concatenated in table order
+    // so the result does not depend on scheduling.
+    // The per-chunk buffers belong to the calling thread and keep their
+    // capacity between scans, so a steady stream of queries does not allocate.
+    template <typename T, typename Out, typename Match>
+    void parallelScan(const CowTable<T>& table, std::vector<Out>& results, const Match& match) {
+        LMS_TRACE_SCOPE("parallel_scan");
+        bool traced = LMS_TRACE_ACTIVE();
+        // Workers name their own thread_local, so the tasks go through a reference
+        thread_local std::vector<std::vector<Out>> buffers;
+        std::vector<std::vector<Out>>& partials = buffers;
+        if (partials.size() < table.chunkCount()) partials.resize(table.chunkCount());
+        pool->parallelFor(table.chunkCount(), [&](size_t c) {
+            LMS_TRACE_CONTINUE("scan_chunk", traced);
+            std::vector<Out>& out = partials[c];
+            out.clear();
+            for (const auto& row : table.chunk(c)) match(*row, out);
+        });
+        results.clear();
+        for (size_t c = 0; c < table.chunkCount(); ++c) {
+            results.insert(results.end(), partials[c].begin(), partials[c].end());
+        }
+    }
+
+    // Logs the notification and, once delivery is started, queues it for recipient
+    void notify(std::string message, const char* type, const User* recipient = nullptr) {
+        LMS_TRACE_SCOPE("push_notification");
+        Notification notice(std::move(message), type);
+        notifications.append(notice);
+        if (recipient) delivery.enqueue(recipient->getId(), recipient->getEmail(), notice);
+    }
+
+    // prefix followed by the resource's title and id, e.g. "Overdue: Dune (ID 7)"
+    std::string noticeAbout(std::string_view prefix, int resourceId) {
+        auto resourceIt = findResource(resourceId);
+        std::string text = resourceIt != resources.end()
+            ? concat(prefix, (*resourceIt)->getTitle(textScratch)) : concat(prefix, "resource");
+        text.append(" (ID ").append(std::to_string(resourceId)).append(")");
+        return text;
+    }
+
+    static Loan restoreLoan(const LoanArchive::Record& r) {
+        return Loan(r[0], r[1], r[2], Date::fromDayNumber(r[3]), Date::fromDayNumber(r[4]),
+                    Date::fromDayNumber(r[5]), true);
+    }
+
+    static Reservation restoreReservation(const ReservationArchive::Record& r) {
+        return Reservation(r[0], r[1], r[2], Date::fromDayNumber(r[3]), false);
+    }
+
+public:
+    LibraryManagementSystem() {
+        commit();
+        void loadData();
+        void initializeLibrarySchedule();
+    }
+
+    ~LibraryManagementSystem() {
+        void saveData();
+    }
+
+    void setConsole(std::ostream& out) { console = &out; }
+
+    // Runs scans on threads threads, the calling one included. Not while a
+    // query is running.
+    void setScanThreads(size_t threads) {
+        if (threads == 0) throw std::invalid_argument("Scans need at least one thread");
+        pool.reset();
+        pool = std::make_unique<WorkStealingPool>(threads - 1);
+    }
+
+    size_t scanThreads() const { return pool->concurrency(); }
+
+    // Resource Management
+    // Operations come in pairs: an overload taking its arguments does the work,
+    // is timed and throws std::invalid_argument on failure; the parameterless
+    // overload prompts for the arguments and reports the outcome.
+    int addResource(std::shared_ptr<Resource> resource) {
+        OperationTimer timer(metrics[Operation::AddResource]);
+        LMS_TRACE_SCOPE(LibraryMetrics::name(Operation::AddResource));
+        int id = resource->getId();
+
+        uint64_t isbn = 0;
+        if (const Book* book = dynamic_cast<const Book*>(resource.get())) {
+            isbn = isbnKey(normalizeIsbn(book->getISBN(textScratch)));
+            auto existing = isbnIndex.find(isbn);
+            if (existing != isbnIndex.end()) {
+                throw std::invalid_argument("ISBN already used by resource " + std::to_string(existing->second));
+            }
+        }
+
+        resource->compressText(textCompressor);
+        const Resource& row = *resource;
+        textBytes += row.getText().textSize();
+        textStoredBytes += row.getText().storedSize();
+        resources.push_back(std::move(resource));
+        if (isbn != 0) isbnIndex.emplace(isbn, id);
+        commit();
+        notify(concat("New resource added: ", row.getTitle(textScratch)), "new_acquisition");
+        timer.succeed();
+        return id;
+    }
+
+    void addResource() {
+        std::string title, author, category;
+        int year, choice;
 
         std::cout << "\n=== Add New Resource ===" << std::endl;
         std::cout << "1. Book\n2. Article\n3. Thesis\n4. Digital Content" << std::endl;
@@ -378,466 +3627,2214 @@ public:
         std::cin >> choice;
         std::cin.ignore();
 
-        std::cout << "Enter title: ";
-        std::getline(std::cin, title);
-        std::cout << "Enter author: ";
-        std::getline(std::cin, author);
-        std::cout << "Enter publication year: ";
-        std::cin >> year;
+        std::cout << "Enter title: ";
+        std::getline(std::cin, title);
+        std::cout << "Enter author: ";
+        std::getline(std::cin, author);
+        std::cout << "Enter publication year: ";
+        std::cin >> year;
+        std::cin.ignore();
+        std::cout << "Enter category: ";
+        std::getline(std::cin, category);
+
+        try {
+            std::shared_ptr<Resource> resource;
+            switch (choice) {
+                case 1: {
+                    std::string isbn;
+                    int pages;
+                    std::cout << "Enter ISBN: ";
+                    std::getline(std::cin, isbn);
+                    std::cout << "Enter number of pages: ";
+                    std::cin >> pages;
+                    resource = std::make_shared<Book>(title, author, year, category, isbn, pages);
+                    break;
+                }
+                case 2: {
+                    std::string journal;
+                    int volume;
+                    std::cout << "Enter journal name: ";
+                    std::getline(std::cin, journal);
+                    std::cout << "Enter volume: ";
+                    std::cin >> volume;
+                    resource = std::make_shared<Article>(title, author, year, category, journal, volume);
+                    break;
+                }
+                case 3: {
+                    std::string degree, university;
+                    std::cout << "Enter degree: ";
+                    std::getline(std::cin, degree);
+                    std::cout << "Enter university: ";
+                    std::getline(std::cin, university);
+                    resource = std::make_shared<Thesis>(title, author, year, category, degree, university);
+                    break;
+                }
+                case 4: {
+                    std::string format;
+                    double fileSize;
+                    std::cout << "Enter format: ";
+                    std::getline(std::cin, format);
+                    std::cout << "Enter file size (MB): ";
+                    std::cin >> fileSize;
+                    resource = std::make_shared<DigitalContent>(title, author, year, category, format, fileSize);
+                    break;
+                }
+                default:
+                    throw std::invalid_argument("Invalid resource type");
+            }
+            addResource(std::move(resource));
+            std::cout << "Resource added successfully!" << std::endl;
+        } catch (const std::exception& e) {
+            std::cout << "Error adding resource: " << e.what() << std::endl;
+        }
+    }
+
+    // Empty strings and a zero year keep the current value
+    void editResource(int id, const std::string& newTitle, const std::string& newAuthor, int newYear) {
+        OperationTimer timer(metrics[Operation::EditResource]);
+        LMS_TRACE_SCOPE(LibraryMetrics::name(Operation::EditResource));
+        auto it = findResource(id);
+        if (it == resources.end()) {
+            throw std::invalid_argument("Resource not found");
+        }
+
+        Resource& resource = resources.edit(it);
+        textBytes -= resource.getText().textSize();
+        textStoredBytes -= resource.getText().storedSize();
+        if (!newTitle.empty()) resource.setTitle(newTitle);
+        if (!newAuthor.empty()) resource.setAuthor(newAuthor);
+        if (newYear != 0) resource.setPublicationYear(newYear);
+        textBytes += resource.getText().textSize();
+        textStoredBytes += resource.getText().storedSize();
+        commit();
+        timer.succeed();
+    }
+
+    void editResource() {
+        int id;
+        std::cout << "Enter resource ID to edit: ";
+        std::cin >> id;
+
+        auto it = findResource(id);
+
+        if (it != resources.end()) {
+            std::string newTitle, newAuthor;
+
+            std::cout << "Current resource details:" << std::endl;
+            (*it)->displayInfo();
+
+            std::cin.ignore();
+            std::string scratch;
+            std::cout << "Enter new title (current: " << (*it)->getTitle(scratch) << "): ";
+            std::getline(std::cin, newTitle);
+
+            std::cout << "Enter new author (current: " << (*it)->getAuthor(scratch) << "): ";
+            std::getline(std::cin, newAuthor);
+
+            std::cout << "Enter new publication year (current: " << (*it)->getPublicationYear() << "): ";
+            std::string yearInput;
+            std::getline(std::cin, yearInput);
+
+            try {
+                editResource(id, newTitle, newAuthor, yearInput.empty() ? 0 : std::stoi(yearInput));
+                std::cout << "Resource updated successfully!" << std::endl;
+            } catch (const std::exception& e) {
+                std::cout << "Error updating resource: " << e.what() << std::endl;
+            }
+        } else {
+            std::cout << "Resource not found!" << std::endl;
+        }
+    }
+
+    // Returns the title of the removed resource
+    std::string removeResource(int id) {
+        OperationTimer timer(metrics[Operation::RemoveResource]);
+        LMS_TRACE_SCOPE(LibraryMetrics::name(Operation::RemoveResource));
+        auto it = findResource(id);
+        if (it == resources.end()) {
+            throw std::invalid_argument("Resource not found");
+        }
+
+        // Check if resource is currently borrowed
+        bool isBorrowed = std::any_of(loans.begin(), loans.end(),
+            [id](const std::shared_ptr<const Loan>& loan) {
+                return loan->getResourceId() == id && !loan->getIsReturned();
+            });
+        if (isBorrowed) {
+            throw std::invalid_argument("Cannot remove resource - it is currently borrowed");
+        }
+
+        std::string title((*it)->getTitle(textScratch));
+        if (const Book* book = dynamic_cast<const Book*>(it->get())) {
+            isbnIndex.erase(isbnKey(normalizeIsbn(book->getISBN(textScratch))));
+        }
+        textBytes -= (*it)->getText().textSize();
+        textStoredBytes -= (*it)->getText().storedSize();
+        resources.erase(it);
+        commit();
+        timer.succeed();
+        return title;
+    }
+
+    void removeResource() {
+        int id;
+        std::cout << "Enter resource ID to remove: ";
+        std::cin >> id;
+
+        try {
+            std::string title = removeResource(id);
+            std::cout << "Resource removed: " << title << std::endl;
+        } catch (const std::exception& e) {
+            std::cout << e.what() << "!" << std::endl;
+        }
+    }
+
+    enum class SearchMode { Keyword = 1, Category = 2, All = 3 };
+
+    // Query methods fill a caller-owned buffer (cleared first) so that a caller
+    // which reuses it across queries does not touch the heap once warmed up.
+    void queryResources(const LibrarySnapshot& snapshot, SearchMode mode, std::string_view term,
+                        std::vector<const Resource*>& results) {
+        OperationTimer timer(metrics[Operation::SearchResources]);
+        LMS_TRACE_SCOPE(LibraryMetrics::name(Operation::SearchResources));
+        parallelScan(snapshot.resources, results,
+            [mode, term](const Resource& resource, std::vector<const Resource*>& out) {
+                thread_local std::string scratch;
+                bool match = mode == SearchMode::All ||
+                    (mode == SearchMode::Keyword &&
+                     (resource.getTitle(scratch).find(term) != std::string_view::npos ||
+                      resource.getAuthor(scratch).find(term) != std::string_view::npos)) ||
+                    (mode == SearchMode::Category && resource.getText().equals(Resource::CategoryText, term, scratch));
+                if (match) out.push_back(&resource);
+            });
+        timer.succeed();
+    }
+
+    // Title hits rank above author-only hits; other modes rank all matches equally
+    static int searchScore(const Resource& resource, SearchMode mode, std::string_view term) {
+        if (mode != SearchMode::Keyword) return 0;
+        thread_local std::string scratch;
+        return resource.getTitle(scratch).find(term) != std::string_view::npos ? 2 : 1;
+    }
+
+    // The best k matches by score, ties going to the lower id. Shards rank
+    // with the same order, so a merged top-k equals the single-process one.
+    // Each match is scored once, into a per-thread buffer, before sorting.
+    void topResources(const LibrarySnapshot& snapshot, SearchMode mode, std::string_view term, size_t k,
+                      std::vector<const Resource*>& results) {
+        queryResources(snapshot, mode, term, results);
+        thread_local std::vector<std::pair<int, const Resource*>> scored;
+        scored.clear();
+        for (const Resource* resource : results) scored.push_back({searchScore(*resource, mode, term), resource});
+        size_t n = std::min(k, scored.size());
+        std::partial_sort(scored.begin(), scored.begin() + n, scored.end(),
+            [](const std::pair<int, const Resource*>& a, const std::pair<int, const Resource*>& b) {
+                return a.first != b.first ? a.first > b.first : a.second->getId() < b.second->getId();
+            });
+        results.clear();
+        for (size_t i = 0; i < n; ++i) results.push_back(scored[i].second);
+    }
+
+    void searchResources() {
+        std::string term;
+        int choice;
+
+        std::cout << "\n=== Search Resources ===" << std::endl;
+        std::cout << "1. Search by keyword\n2. Search by category\n3. Show all resources" << std::endl;
+        std::cout << "Choose search option: ";
+        std::cin >> choice;
+        std::cin.ignore();
+
+        switch (choice) {
+            case 1:
+                std::cout << "Enter keyword: ";
+                std::getline(std::cin, term);
+                break;
+            case 2:
+                std::cout << "Enter category: ";
+                std::getline(std::cin, term);
+                break;
+            case 3:
+                break;
+            default:
+                std::cout << "Invalid option!" << std::endl;
+                return;
+        }
+
+        // The snapshot keeps the matched rows alive while they are displayed
+        std::shared_ptr<const LibrarySnapshot> snapshot = pinSnapshot();
+        std::vector<const Resource*> results;
+        queryResources(*snapshot, static_cast<SearchMode>(choice), term, results);
+
+        if (results.empty()) {
+            std::cout << "No resources found!" << std::endl;
+        } else {
+            std::cout << "\nSearch Results (" << results.size() << " found):" << std::endl;
+            std::cout << std::string(80, '-') << std::endl;
+            for (const auto& resource : results) {
+                resource->displayInfo();
+                std::cout << std::string(80, '-') << std::endl;
+            }
+        }
+    }
+
+    // Accepts ISBN-10 or ISBN-13 in any hyphenation; returns nullptr when not
+    // found. The row is immutable and stays valid after later edits.
+    CowTable<Resource>::Row findResourceByIsbn(std::string_view isbn) {
+        OperationTimer timer(metrics[Operation::FindByIsbn]);
+        LMS_TRACE_SCOPE(LibraryMetrics::name(Operation::FindByIsbn));
+        auto entry = isbnIndex.find(isbnKey(normalizeIsbn(isbn)));
+        timer.succeed();
+        if (entry == isbnIndex.end()) return nullptr;
+        return *findResource(entry->second);
+    }
+
+    void lookupResourceByIsbn() {
+        std::string isbn;
+        std::cout << "Enter or scan ISBN: ";
+        std::cin >> isbn;
+
+        try {
+            if (CowTable<Resource>::Row resource = findResourceByIsbn(isbn)) {
+                resource->displayInfo();
+            } else {
+                std::cout << "No resource with this ISBN!" << std::endl;
+            }
+        } catch (const std::exception& e) {
+            std::cout << e.what() << std::endl;
+        }
+    }
+
+    // Groups all books by canonical ISBN and all users by folded email and
+    // lists every key held by more than one record. addResource() only
+    // accepts valid ISBNs, so every stored one normalizes.
+    void duplicateReport() {
+        OperationTimer timer(metrics[Operation::DuplicateReport]);
+        LMS_TRACE_SCOPE(LibraryMetrics::name(Operation::DuplicateReport));
+        std::cout << "\n=== Duplicate Report ===" << std::endl;
+        std::shared_ptr<const LibrarySnapshot> snapshot = pinSnapshot();
+
+        std::unordered_map<std::string, std::vector<int>> byIsbn;
+        byIsbn.reserve(snapshot->resources.size());
+        std::string scratch;
+        for (const auto& resource : snapshot->resources) {
+            const Book* book = dynamic_cast<const Book*>(resource.get());
+            if (book) byIsbn[normalizeIsbn(book->getISBN(scratch))].push_back(book->getId());
+        }
+
+        std::unordered_map<std::string, std::vector<int>> byEmail;
+        byEmail.reserve(snapshot->users.size());
+        std::string folded;
+        for (const auto& user : snapshot->users) {
+            foldEmail(user->getEmail(), folded);
+            if (!folded.empty()) byEmail[folded].push_back(user->getId());
+        }
+
+        auto printGroups = [](const char* label, const std::unordered_map<std::string, std::vector<int>>& groups) {
+            std::vector<std::pair<std::string, std::vector<int>>> duplicates;
+            for (const auto& group : groups) {
+                if (group.second.size() > 1) duplicates.push_back(group);
+            }
+            std::sort(duplicates.begin(), duplicates.end());
+            for (const auto& group : duplicates) {
+                std::cout << label << " " << group.first << ":";
+                for (int id : group.second) std::cout << " " << id;
+                std::cout << std::endl;
+            }
+            return duplicates.size();
+        };
+
+        size_t found = printGroups("ISBN", byIsbn) + printGroups("Email", byEmail);
+        if (found == 0) {
+            std::cout << "No duplicates found!" << std::endl;
+        }
+        timer.succeed();
+    }
+
+    // User Management
+    int addUser(const std::string& name, const std::string& email, const std::string& userType) {
+        OperationTimer timer(metrics[Operation::AddUser]);
+        LMS_TRACE_SCOPE(LibraryMetrics::name(Operation::AddUser));
+        std::string folded;
+        foldEmail(email, folded);
+        auto existing = emailIndex.find(folded);
+        if (!folded.empty() && existing != emailIndex.end()) {
+            throw std::invalid_argument("Email already registered to user " + std::to_string(existing->second));
+        }
+
+        users.push_back(std::make_shared<User>(name, email, userType));
+        if (!folded.empty()) emailIndex.emplace(folded, users.back()->getId());
+        commit();
+        timer.succeed();
+        return users.back()->getId();
+    }
+
+    void addUser() {
+        std::string name, email, userType;
+
+        std::cout << "\n=== Add New User ===" << std::endl;
         std::cin.ignore();
-        std::cout << "Enter category: ";
-        std::getline(std::cin, category);
+        std::cout << "Enter name: ";
+        std::getline(std::cin, name);
+        std::cout << "Enter email: ";
+        std::getline(std::cin, email);
+        std::cout << "Enter user type (Student/Faculty/Staff): ";
+        std::getline(std::cin, userType);
+
+        try {
+            int id = addUser(name, email, userType);
+            std::cout << "User added successfully! User ID: " << id << std::endl;
+        } catch (const std::exception& e) {
+            std::cout << "Error adding user: " << e.what() << std::endl;
+        }
+    }
+
+    // Returns nullptr when no user has this email (compared
+    // case-insensitively). The row is immutable and stays valid after later edits.
+    CowTable<User>::Row findUserByEmail(std::string_view email) {
+        OperationTimer timer(metrics[Operation::FindByEmail]);
+        LMS_TRACE_SCOPE(LibraryMetrics::name(Operation::FindByEmail));
+        thread_local std::string folded;
+        foldEmail(email, folded);
+        auto entry = emailIndex.find(folded);
+        timer.succeed();
+        if (entry == emailIndex.end()) return nullptr;
+        return *findUser(entry->second);
+    }
+
+    void lookupUserByEmail() {
+        std::string email;
+        std::cout << "Enter email: ";
+        std::cin >> email;
+
+        if (CowTable<User>::Row user = findUserByEmail(email)) {
+            user->displayInfo();
+        } else {
+            std::cout << "No user with this email!" << std::endl;
+        }
+    }
+
+    void viewUsers() {
+        OperationTimer timer(metrics[Operation::ViewUsers]);
+        LMS_TRACE_SCOPE(LibraryMetrics::name(Operation::ViewUsers));
+        if (users.empty()) {
+            std::cout << "No users found!" << std::endl;
+            timer.succeed();
+            return;
+        }
+
+        std::cout << "\n=== All Users ===" << std::endl;
+        for (const auto& user : users) {
+            user->displayInfo();
+        }
+        timer.succeed();
+    }
+
+    // Borrowing System
+    Loan borrowResource(int userId, int resourceId) {
+        OperationTimer timer(metrics[Operation::BorrowResource]);
+        LMS_TRACE_SCOPE(LibraryMetrics::name(Operation::BorrowResource));
+
+        // Validate user
+        auto userIt = findUser(userId);
+        if (userIt == users.end()) {
+            throw std::invalid_argument("User not found");
+        }
+        const User* borrower = userIt->get();
+
+        // Validate resource
+        auto resourceIt = findResource(resourceId);
+        if (resourceIt == resources.end()) {
+            throw std::invalid_argument("Resource not found");
+        }
+
+        // Check availability
+        if (!(*resourceIt)->getAvailability()) {
+            throw std::invalid_argument("Resource is not available");
+        }
+
+        // Create loan
+        loans.push_back(std::make_shared<Loan>(userId, resourceId));
+        resources.edit(resourceIt).setAvailability(false);
+
+        // A reservation held by this user is fulfilled by the loan
+        auto reservationIt = std::find_if(reservations.begin(), reservations.end(),
+            [userId, resourceId](const std::shared_ptr<const Reservation>& r) {
+                return r->getUserId() == userId && r->getResourceId() == resourceId && r->getIsActive();
+            });
+        if (reservationIt != reservations.end()) {
+            reservations.edit(reservationIt).deactivate();
+            archiveReservation(reservationIt);
+        }
+        commit();
+
+        {
+            LMS_TRACE_SCOPE("co_borrow_update");
+            int today = Date().toDayNumber();
+            if (coBorrow.recordBorrow(userId, resourceId, today)) coBorrow.startRebuild(pinSnapshot(), today);
+        }
+
+        // Add notification
+        notify(concat("Resource borrowed: ", (*resourceIt)->getTitle(textScratch)), "borrow", borrower);
+
+        timer.succeed();
+        return *loans.back();
+    }
+
+    void borrowResource() {
+        int userId, resourceId;
+
+        std::cout << "\n=== Borrow Resource ===" << std::endl;
+        std::cout << "Enter user ID: ";
+        std::cin >> userId;
+        std::cout << "Enter resource ID: ";
+        std::cin >> resourceId;
+
+        try {
+            Loan loan = borrowResource(userId, resourceId);
+            std::cout << "Resource borrowed successfully!" << std::endl;
+            std::cout << "Due date: " << loan.getDueDate() << std::endl;
+        } catch (const std::exception& e) {
+            std::cout << "Error borrowing resource: " << e.what() << std::endl;
+        }
+    }
+
+    void returnResource(int loanId) {
+        OperationTimer timer(metrics[Operation::ReturnResource]);
+        LMS_TRACE_SCOPE(LibraryMetrics::name(Operation::ReturnResource));
+        auto loanIt = findLoan(loanId);
+        if (loanIt == loans.end() || (*loanIt)->getIsReturned()) {
+            throw std::invalid_argument("Loan not found or already returned");
+        }
+
+        loans.edit(loanIt).returnResource();
+
+        // Make resource available
+        int resourceId = (*loanIt)->getResourceId();
+        auto resourceIt = findResource(resourceId);
+        if (resourceIt != resources.end()) {
+            resources.edit(resourceIt).setAvailability(true);
+        }
+
+        archiveLoan(loanIt);
+        commit();
+
+        // Check for reservations
+        checkReservations(resourceId);
+        timer.succeed();
+    }
+
+    void returnResource() {
+        int loanId;
+        std::cout << "\n=== Return Resource ===" << std::endl;
+        std::cout << "Enter loan ID: ";
+        std::cin >> loanId;
+
+        try {
+            returnResource(loanId);
+            std::cout << "Resource returned successfully!" << std::endl;
+        } catch (const std::exception& e) {
+            std::cout << e.what() << "!" << std::endl;
+        }
+    }
+
+    // Returns the new due date
+    Date renewResource(int loanId) {
+        OperationTimer timer(metrics[Operation::RenewResource]);
+        LMS_TRACE_SCOPE(LibraryMetrics::name(Operation::RenewResource));
+        auto loanIt = findLoan(loanId);
+        if (loanIt == loans.end() || (*loanIt)->getIsReturned()) {
+            throw std::invalid_argument("Loan not found or already returned");
+        }
+
+        // Check if there are reservations for this resource
+        int resourceId = (*loanIt)->getResourceId();
+        bool hasReservation = std::any_of(reservations.begin(), reservations.end(),
+            [resourceId](const std::shared_ptr<const Reservation>& r) {
+                return r->getResourceId() == resourceId && r->getIsActive();
+            });
+        if (hasReservation) {
+            throw std::invalid_argument("Cannot renew - resource has reservations");
+        }
+
+        loans.edit(loanIt).extendDueDate(14);
+        commit();
+        timer.succeed();
+        return (*loanIt)->getDueDate();
+    }
+
+    void renewResource() {
+        int loanId;
+        std::cout << "\n=== Renew Resource ===" << std::endl;
+        std::cout << "Enter loan ID: ";
+        std::cin >> loanId;
 
         try {
-            switch (choice) {
-                case 1: {
-                    std::string isbn;
-                    int pages;
-                    std::cout << "Enter ISBN: ";
-                    std::getline(std::cin, isbn);
-                    std::cout << "Enter number of pages: ";
-                    std::cin >> pages;
-                    resources.push_back(std::make_unique<Book>(title, author, year, category, isbn, pages));
-                    break;
-                }
-                case 2: {
-                    std::string journal;
-                    int volume;
-                    std::cout << "Enter journal name: ";
-                    std::getline(std::cin, journal);
-                    std::cout << "Enter volume: ";
-                    std::cin >> volume;
-                    resources.push_back(std::make_unique<Article>(title, author, year, category, journal, volume));
-                    break;
-                }
-                case 3: {
-                    std::string degree, university;
-                    std::cout << "Enter degree: ";
-                    std::getline(std::cin, degree);
-                    std::cout << "Enter university: ";
-                    std::getline(std::cin, university);
-                    resources.push_back(std::make_unique<Thesis>(title, author, year, category, degree, university));
-                    break;
-                }
-                case 4: {
-                    std::string format;
-                    double fileSize;
-                    std::cout << "Enter format: ";
-                    std::getline(std::cin, format);
-                    std::cout << "Enter file size (MB): ";
-                    std::cin >> fileSize;
-                    resources.push_back(std::make_unique<DigitalContent>(title, author, year, category, format, fileSize));
-                    break;
+            Date dueDate = renewResource(loanId);
+            std::cout << "Resource renewed successfully!" << std::endl;
+            std::cout << "New due date: " << dueDate << std::endl;
+        } catch (const std::exception& e) {
+            std::cout << e.what() << "!" << std::endl;
+        }
+    }
+
+    // Returned loans live in the cold archive, active ones in the hot table.
+    // Archive blocks and table chunks are scanned as one parallel task set.
+    void queryBorrowHistory(const LibrarySnapshot& snapshot, int userId, std::vector<Loan>& history) {
+        OperationTimer timer(metrics[Operation::BorrowHistory]);
+        LMS_TRACE_SCOPE(LibraryMetrics::name(Operation::BorrowHistory));
+        const LoanArchive& archive = snapshot.loanArchive;
+        const CowTable<Loan>& active = snapshot.loans;
+        size_t blockCount = archive.blockCount();
+
+        bool traced = LMS_TRACE_ACTIVE();
+        size_t taskCount = blockCount + active.chunkCount();
+        thread_local std::vector<std::vector<Loan>> buffers;
+        std::vector<std::vector<Loan>>& partials = buffers;
+        if (partials.size() < taskCount) partials.resize(taskCount);
+        pool->parallelFor(taskCount, [&](size_t task) {
+            LMS_TRACE_CONTINUE(task < blockCount ? "scan_archive_block" : "scan_chunk", traced);
+            std::vector<Loan>& out = partials[task];
+            out.clear();
+            if (task < blockCount) {
+                archive.forEachInBlock(task, [&](const LoanArchive::Record& r) {
+                    if (r[1] == userId) out.push_back(restoreLoan(r));
+                });
+            } else {
+                for (const auto& loan : active.chunk(task - blockCount)) {
+                    if (loan->getUserId() == userId) out.push_back(*loan);
                 }
-                default:
-                    throw std::invalid_argument("Invalid resource type");
             }
-            std::cout << "Resource added successfully!" << std::endl;
-            notifications.push_back(Notification("New resource added: " + title, "new_acquisition"));
+        });
+
+        history.clear();
+        for (size_t task = 0; task < taskCount; ++task) {
+            history.insert(history.end(), partials[task].begin(), partials[task].end());
+        }
+        std::sort(history.begin(), history.end(),
+            [](const Loan& a, const Loan& b) { return a.getId() < b.getId(); });
+        timer.succeed();
+    }
+
+    // Resources most often borrowed by the same patrons shortly before or
+    // after this one, best first
+    void alsoBorrowed(int resourceId, size_t k, std::vector<CoBorrowIndex::Recommendation>& out) {
+        OperationTimer timer(metrics[Operation::AlsoBorrowed]);
+        LMS_TRACE_SCOPE(LibraryMetrics::name(Operation::AlsoBorrowed));
+        if (findResource(resourceId) == resources.end()) {
+            throw std::invalid_argument("Resource not found");
+        }
+        coBorrow.alsoBorrowed(resourceId, Date().toDayNumber(), k, out);
+        timer.succeed();
+    }
+
+    void viewAlsoBorrowed() {
+        int resourceId;
+        std::cout << "Enter resource ID: ";
+        std::cin >> resourceId;
+
+        try {
+            std::vector<CoBorrowIndex::Recommendation> recommendations;
+            alsoBorrowed(resourceId, 10, recommendations);
+            std::cout << "\n=== Patrons Who Borrowed This Also Borrowed ===" << std::endl;
+            for (const auto& recommendation : recommendations) {
+                auto resourceIt = findResource(recommendation.resourceId);
+                if (resourceIt == resources.end()) continue;
+                std::ostringstream score;
+                score << std::fixed << std::setprecision(2) << recommendation.score;
+                std::cout << "ID: " << recommendation.resourceId << ", Title: " << (*resourceIt)->getTitle(textScratch)
+                          << ", Score: " << score.str() << std::endl;
+            }
+            if (recommendations.empty()) {
+                std::cout << "No recommendations yet for this resource!" << std::endl;
+            }
         } catch (const std::exception& e) {
-            std::cout << "Error adding resource: " << e.what() << std::endl;
+            std::cout << e.what() << "!" << std::endl;
         }
     }
 
-    void editResource() {
+    void viewBorrowHistory() {
+        int userId;
+        std::cout << "Enter user ID: ";
+        std::cin >> userId;
+
+        std::cout << "\n=== Borrow History for User " << userId << " ===" << std::endl;
+
+        std::vector<Loan> history;
+        queryBorrowHistory(*pinSnapshot(), userId, history);
+        for (const auto& loan : history) {
+            loan.displayInfo();
+        }
+
+        if (history.empty()) {
+            std::cout << "No borrow history found for this user!" << std::endl;
+        }
+    }
+
+    // Reservation System
+    // Returns the reservation id, or 0 when the resource is available to borrow
+    int reserveResource(int userId, int resourceId) {
+        OperationTimer timer(metrics[Operation::ReserveResource]);
+        LMS_TRACE_SCOPE(LibraryMetrics::name(Operation::ReserveResource));
+
+        // Validate user and resource
+        if (findUser(userId) == users.end()) {
+            throw std::invalid_argument("User not found");
+        }
+
+        auto resourceIt = findResource(resourceId);
+        if (resourceIt == resources.end()) {
+            throw std::invalid_argument("Resource not found");
+        }
+
+        // Check if resource is available
+        if ((*resourceIt)->getAvailability()) {
+            timer.succeed();
+            return 0;
+        }
+
+        // Check if user already has a reservation for this resource
+        bool alreadyReserved = std::any_of(reservations.begin(), reservations.end(),
+            [userId, resourceId](const std::shared_ptr<const Reservation>& r) {
+                return r->getUserId() == userId && r->getResourceId() == resourceId && r->getIsActive();
+            });
+
+        if (alreadyReserved) {
+            throw std::invalid_argument("You already have a reservation for this resource");
+        }
+
+        reservations.push_back(std::make_shared<Reservation>(userId, resourceId));
+        commit();
+        timer.succeed();
+        return reservations.back()->getId();
+    }
+
+    void reserveResource() {
+        int userId, resourceId;
+
+        std::cout << "\n=== Reserve Resource ===" << std::endl;
+        std::cout << "Enter user ID: ";
+        std::cin >> userId;
+        std::cout << "Enter resource ID: ";
+        std::cin >> resourceId;
+
+        try {
+            if (reserveResource(userId, resourceId) == 0) {
+                std::cout << "Resource is available - you can borrow it directly!" << std::endl;
+            } else {
+                std::cout << "Resource reserved successfully!" << std::endl;
+            }
+        } catch (const std::exception& e) {
+            std::cout << "Error reserving resource: " << e.what() << std::endl;
+        }
+    }
+
+    void queryReservations(const LibrarySnapshot& snapshot, int userId,
+                           std::vector<const Reservation*>& results) {
+        OperationTimer timer(metrics[Operation::ViewReservations]);
+        LMS_TRACE_SCOPE(LibraryMetrics::name(Operation::ViewReservations));
+        results.clear();
+        for (const auto& reservation : snapshot.reservations) {
+            if (reservation->getUserId() == userId && reservation->getIsActive()) {
+                results.push_back(reservation.get());
+            }
+        }
+        timer.succeed();
+    }
+
+    void viewReservations() {
+        int userId;
+        std::cout << "Enter user ID: ";
+        std::cin >> userId;
+
+        std::cout << "\n=== Reservations for User " << userId << " ===" << std::endl;
+        std::shared_ptr<const LibrarySnapshot> snapshot = pinSnapshot();
+        std::vector<const Reservation*> results;
+        queryReservations(*snapshot, userId, results);
+        for (const Reservation* reservation : results) {
+            reservation->displayInfo();
+        }
+
+        if (results.empty()) {
+            std::cout << "No active reservations found for this user!" << std::endl;
+        }
+    }
+
+    void checkReservations(int resourceId) {
+        LMS_TRACE_SCOPE("check_reservations");
+        auto reservationIt = std::find_if(reservations.begin(), reservations.end(),
+            [resourceId](const std::shared_ptr<const Reservation>& r) {
+                return r->getResourceId() == resourceId && r->getIsActive();
+            });
+
+        if (reservationIt != reservations.end()) {
+            auto userIt = findUser((*reservationIt)->getUserId());
+
+            if (userIt != users.end()) {
+                *console << "Notifying user " << (*userIt)->getName()
+                         << " that reserved resource is now available!" << std::endl;
+                notify(noticeAbout("Reserved resource is now available: ", resourceId), "available", userIt->get());
+            }
+        }
+    }
+
+    // Reports
+    std::shared_ptr<const LibrarySnapshot> pinSnapshot() const {
+        return std::atomic_load(&published);
+    }
+
+    void exportSnapshot() {
+        std::string filename;
+        std::cout << "\n=== Export Snapshot ===" << std::endl;
+        std::cout << "Enter export file name: ";
+        std::cin >> filename;
+
+        OperationTimer timer(metrics[Operation::ExportSnapshot]);
+
+        LMS_TRACE_SCOPE(LibraryMetrics::name(Operation::ExportSnapshot));
+
+        // Writers may keep committing while the export runs; it only reads the pinned version
+        std::shared_ptr<const LibrarySnapshot> snapshot = pinSnapshot();
+        std::ofstream out(filename);
+        if (!out) {
+            std::cout << "Cannot open " << filename << " for writing!" << std::endl;
+            return;
+        }
+
+        out << "# snapshot version " << snapshot->version << "\n";
+        out << "# resources\n";
+        std::string row;
+        for (const auto& resource : snapshot->resources) {
+            row.clear();
+            resource->appendCsv(row);
+            out << row << "\n";
+        }
+        out << "# users\n";
+        for (const auto& user : snapshot->users) out << user->toCSV() << "\n";
+        out << "# loans\n";
+        snapshot->loanArchive.forEach([&out](const LoanArchive::Record& r) {
+            out << restoreLoan(r).toCSV() << "\n";
+        });
+        for (const auto& loan : snapshot->loans) out << loan->toCSV() << "\n";
+        out << "# reservations\n";
+        snapshot->reservationArchive.forEach([&out](const ReservationArchive::Record& r) {
+            out << restoreReservation(r).toCSV() << "\n";
+        });
+        for (const auto& reservation : snapshot->reservations) out << reservation->toCSV() << "\n";
+        timer.succeed();
+
+        std::cout << "Exported snapshot version " << snapshot->version << ": "
+                  << snapshot->resources.size() << " resources, " << snapshot->users.size() << " users, "
+                  << snapshot->loans.size() + snapshot->loanArchive.size() << " loans, "
+                  << snapshot->reservations.size() + snapshot->reservationArchive.size() << " reservations" << std::endl;
+    }
+
+    // Statistics
+    LibraryMetrics::Gauges collectionGauges() const {
+        LibraryMetrics::Gauges gauges = {
+            {"resources", resources.size()},
+            {"users", users.size()},
+            {"active_loans", loans.size()},
+            {"archived_loans", loanArchive.size()},
+            {"active_reservations", reservations.size()},
+            {"archived_reservations", reservationArchive.size()},
+            {"notifications", notifications.size()},
+            {"co_borrow_entries", coBorrow.entryCount()},
+            {"co_borrow_rebuilds", static_cast<size_t>(coBorrow.rebuildCount())},
+            {"text_bytes", textBytes},
+            {"text_stored_bytes", textStoredBytes}
+        };
+        if (delivery.enabled()) {
+            NotificationDispatcher::Counters sent = delivery.counters();
+            for (const auto& counter : {std::make_pair("notifications_queued", sent.enqueued - sent.delivered - sent.dropped),
+                                        std::make_pair("notifications_delivered", sent.delivered),
+                                        std::make_pair("notifications_dropped", sent.dropped),
+                                        std::make_pair("notification_batches", sent.batches),
+                                        std::make_pair("notification_retries", sent.retries)}) {
+                gauges.emplace_back(counter.first, static_cast<size_t>(counter.second));
+            }
+        }
+        return gauges;
+    }
+
+    void viewStatistics() const {
+        std::cout << "\n=== Operation Statistics ===" << std::endl;
+        metrics.writeSummary(std::cout, collectionGauges());
+    }
+
+    void writeMetricsFile() const {
+        std::string filename;
+        std::cout << "Enter metrics file name: ";
+        std::cin >> filename;
+
+        std::ofstream out(filename);
+        if (!out) {
+            std::cout << "Cannot open " << filename << " for writing!" << std::endl;
+            return;
+        }
+        metrics.writePrometheus(out, collectionGauges());
+        std::cout << "Metrics written to " << filename << std::endl;
+    }
+
+    void writeTraceFile() const {
+        std::string filename;
+        std::cout << "Enter trace file name: ";
+        std::cin >> filename;
+
+        std::ofstream out(filename);
+        if (!out) {
+            std::cout << "Cannot open " << filename << " for writing!" << std::endl;
+            return;
+        }
+        Tracer::instance().writeChromeTrace(out);
+        std::cout << Tracer::instance().eventCount() << " trace events written to " << filename;
+        if (Tracer::instance().sampleRate() == 0) {
+            std::cout << " (sampling is off; set LMS_TRACE_SAMPLE=n to trace 1 in n operations)" << std::endl;
+        } else {
+            std::cout << " (sampling 1 in " << Tracer::instance().sampleRate() << " operations)" << std::endl;
+        }
+    }
+
+    // Notifications
+    // From now on notifications addressed to a patron are also sent to their
+    // email through sink, on the delivery thread
+    void startNotificationDelivery(std::shared_ptr<NotificationSink> sink, const NotificationDispatcher::Config& config) {
+        delivery.start(std::move(sink), config);
+    }
+
+    // Waits until every queued notification has been delivered or dropped
+    void flushNotifications() { delivery.flush(); }
+
+    NotificationDispatcher::Counters deliveryCounters() const { return delivery.counters(); }
+
+    void viewNotifications() {
+        OperationTimer timer(metrics[Operation::ViewNotifications]);
+        LMS_TRACE_SCOPE(LibraryMetrics::name(Operation::ViewNotifications));
+        std::cout << "\n=== Recent Notifications ===" << std::endl;
+        if (notifications.empty()) {
+            std::cout << "No notifications!" << std::endl;
+            timer.succeed();
+            return;
+        }
+
+        // Show last 10 notifications
+        size_t start = notifications.size() > 10 ? notifications.size() - 10 : 0;
+        for (size_t i = start; i < notifications.size(); ++i) {
+            notifications[i].display();
+        }
+        timer.succeed();
+    }
+
+    void queryOverdueLoans(const LibrarySnapshot& snapshot, const Date& today, std::vector<const Loan*>& overdue) {
+        parallelScan(snapshot.loans, overdue, [&today](const Loan& loan, std::vector<const Loan*>& out) {
+            if (loan.isOverdue(today)) out.push_back(&loan);
+        });
+    }
+
+    // Collects the overdue loans into overdue and notifies the borrowers of
+    // those not notified yet for their current due date
+    void checkOverdueItems(const LibrarySnapshot& snapshot, const Date& today, std::vector<const Loan*>& overdue) {
+        OperationTimer timer(metrics[Operation::CheckOverdue]);
+        LMS_TRACE_SCOPE(LibraryMetrics::name(Operation::CheckOverdue));
+        queryOverdueLoans(snapshot, today, overdue);
+
+        for (const Loan* loan : overdue) {
+            int due = loan->getDueDate().toDayNumber();
+            auto [noticeIt, first] = overdueNotified.try_emplace(loan->getId(), due);
+            if (!first) {
+                if (noticeIt->second == due) continue;
+                noticeIt->second = due;
+            }
+            auto userIt = findUser(loan->getUserId());
+            if (userIt != users.end()) {
+                std::string message = noticeAbout("Overdue: ", loan->getResourceId());
+                message.append(", due ").append(loan->getDueDate().toString());
+                notify(std::move(message), "overdue", userIt->get());
+            }
+        }
+        timer.succeed();
+    }
+
+    void checkOverdueItems() {
+        std::cout << "\n=== Overdue Items ===" << std::endl;
+        std::shared_ptr<const LibrarySnapshot> snapshot = pinSnapshot();
+        std::vector<const Loan*> overdue;
+        checkOverdueItems(*snapshot, Date(), overdue);
+
+        for (const Loan* loan : overdue) {
+            loan->displayInfo();
+        }
+
+        if (overdue.empty()) {
+            std::cout << "No overdue items!" << std::endl;
+        }
+    }
+};
+
+// Resident set size of this process in bytes, or 0 where it is unknown
+inline size_t residentBytes() {
+#if defined(__linux__)
+    std::ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    statm >> pages >> resident;
+    return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#else
+    return 0;
+#endif
+}
+
+#if LMS_HAS_SHARDS
+// One end of a coordinator/shard connection. A message is a list of fields,
+// each sent with a 4-byte big-endian length so a field may hold any byte,
+// inside a frame that starts with the 4-byte length of the whole message.
+class ShardChannel {
+private:
+    int fd;
+    std::string frame;
+
+    void writeAll(const char* data, size_t size) {
+        while (size > 0) {
+            ssize_t n = ::write(fd, data, size);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) throw std::runtime_error("Shard connection lost");
+            data += n;
+            size -= static_cast<size_t>(n);
+        }
+    }
+
+    // Returns false on a clean end of stream before the first byte
+    bool readAll(char* data, size_t size) {
+        size_t done = 0;
+        while (done < size) {
+            ssize_t n = ::read(fd, data + done, size - done);
+            if (n < 0 && errno == EINTR) continue;
+            if (n == 0 && done == 0) return false;
+            if (n <= 0) throw std::runtime_error("Shard connection lost");
+            done += static_cast<size_t>(n);
+        }
+        return true;
+    }
+
+public:
+    explicit ShardChannel(int socket) : fd(socket) {}
+
+    int descriptor() const { return fd; }
+
+    static void putLength(std::string& out, size_t offset, size_t length) {
+        uint32_t size = static_cast<uint32_t>(length);
+        for (int i = 0; i < 4; ++i) out[offset + i] = static_cast<char>(size >> (24 - 8 * i));
+    }
+
+    static uint32_t getLength(const char* data) {
+        uint32_t size = 0;
+        for (int i = 0; i < 4; ++i) size = (size << 8) | static_cast<unsigned char>(data[i]);
+        return size;
+    }
+
+    void send(const std::vector<std::string>& fields) {
+        frame.assign(4, '\0');
+        for (const auto& field : fields) {
+            size_t offset = frame.size();
+            frame.append(4, '\0');
+            putLength(frame, offset, field.size());
+            frame += field;
+        }
+        putLength(frame, 0, frame.size() - 4);
+        writeAll(frame.data(), frame.size());
+    }
+
+    // Returns false when the other end has closed the connection
+    bool receive(std::vector<std::string>& fields) {
+        char header[4];
+        if (!readAll(header, 4)) return false;
+        uint32_t size = getLength(header);
+        frame.resize(size);
+        if (size > 0 && !readAll(&frame[0], size)) throw std::runtime_error("Shard connection lost");
+
+        fields.clear();
+        for (size_t offset = 0; offset < frame.size();) {
+            if (frame.size() - offset < 4) throw std::runtime_error("Malformed shard message");
+            uint32_t length = getLength(frame.data() + offset);
+            offset += 4;
+            if (frame.size() - offset < length) throw std::runtime_error("Malformed shard message");
+            fields.emplace_back(frame, offset, length);
+            offset += length;
+        }
+        return true;
+    }
+};
+
+// Serves one partition of the catalog in a worker process. Loans and
+// reservations get shard-local ids; on the wire they carry a 64-bit global
+// id local * shards + shard, so the coordinator can route them by id alone.
+class ShardWorker {
+private:
+    ShardChannel channel;
+    int shard;
+    int shards;
+    LibraryManagementSystem library;
+    std::vector<const Resource*> found;
+    std::vector<Loan> history;
+    std::vector<const Loan*> overdue;
+    std::string text;
+
+    int64_t globalId(int localId) const { return static_cast<int64_t>(localId) * shards + shard; }
+    int localId(int64_t global) const { return static_cast<int>(global / shards); }
+
+    static int number(const std::vector<std::string>& request, size_t i) {
+        return std::stoi(request.at(i));
+    }
+
+    static int64_t globalNumber(const std::vector<std::string>& request, size_t i) {
+        return std::stoll(request.at(i));
+    }
+
+    void handle(const std::vector<std::string>& request, std::vector<std::string>& reply) {
+        const std::string& op = request.at(0);
+        if (op == "today") {
+            Date::setVirtualToday(number(request, 1));
+        } else if (op == "user") {
+            reply.push_back(std::to_string(library.addUser(request.at(1), request.at(2), request.at(3))));
+        } else if (op == "resource") {
+            reply.push_back(std::to_string(library.addResource(makeResource(JsonCodec::decode(request.at(1))))));
+        } else if (op == "borrow") {
+            Loan loan = library.borrowResource(number(request, 1), number(request, 2));
+            reply.push_back(std::to_string(globalId(loan.getId())));
+            reply.push_back(std::to_string(loan.getDueDate().toDayNumber()));
+        } else if (op == "return") {
+            library.returnResource(localId(globalNumber(request, 1)));
+        } else if (op == "renew") {
+            reply.push_back(std::to_string(library.renewResource(localId(globalNumber(request, 1))).toDayNumber()));
+        } else if (op == "reserve") {
+            int id = library.reserveResource(number(request, 1), number(request, 2));
+            reply.push_back(std::to_string(id == 0 ? int64_t(0) : globalId(id)));
+        } else if (op == "isbn") {
+            CowTable<Resource>::Row resource = library.findResourceByIsbn(request.at(1));
+            reply.push_back(std::to_string(resource ? resource->getId() : 0));
+        } else if (op == "search") {
+            auto mode = static_cast<LibraryManagementSystem::SearchMode>(number(request, 1));
+            library.topResources(*library.pinSnapshot(), mode, request.at(3), static_cast<size_t>(number(request, 2)), found);
+            for (const Resource* resource : found) {
+                reply.push_back(std::to_string(resource->getId()));
+                reply.push_back(std::to_string(LibraryManagementSystem::searchScore(*resource, mode, request.at(3))));
+                reply.emplace_back(resource->getTitle(text));
+            }
+        } else if (op == "history") {
+            library.queryBorrowHistory(*library.pinSnapshot(), number(request, 1), history);
+            for (const Loan& loan : history) {
+                reply.push_back(std::to_string(globalId(loan.getId())));
+                reply.push_back(std::to_string(loan.getResourceId()));
+                reply.push_back(std::to_string(loan.getBorrowDate().toDayNumber()));
+                reply.push_back(std::to_string(loan.getDueDate().toDayNumber()));
+                reply.push_back(std::to_string(loan.getReturnDate().toDayNumber()));
+                reply.push_back(loan.getIsReturned() ? "1" : "0");
+            }
+        } else if (op == "overdue") {
+            library.checkOverdueItems(*library.pinSnapshot(), Date(), overdue);
+            reply.push_back(std::to_string(overdue.size()));
+        } else if (op == "gauges") {
+            for (const auto& gauge : library.collectionGauges()) {
+                reply.push_back(gauge.first);
+                reply.push_back(std::to_string(gauge.second));
+            }
+            reply.push_back("resident_bytes");
+            reply.push_back(std::to_string(residentBytes()));
+        } else {
+            throw std::invalid_argument("Unknown shard operation: " + op);
+        }
+    }
+
+public:
+    ShardWorker(int socket, int shardIndex, int shardCount, std::ostream& console)
+        : channel(socket), shard(shardIndex), shards(shardCount) {
+        library.setConsole(console);
+    }
+
+    // Answers requests until the coordinator closes the connection. Every
+    // reply starts with "ok" or with "error" followed by the message.
+    void serve() {
+        std::vector<std::string> request, reply;
+        while (channel.receive(request)) {
+            reply.assign(1, "ok");
+            try {
+                handle(request, reply);
+            } catch (const std::exception& e) {
+                reply.assign({"error", e.what()});
+            }
+            channel.send(reply);
+        }
+    }
+};
+
+// Coordinator of a catalog hash-partitioned across worker processes. Users
+// are replicated to every shard; a resource, its loans and its reservations
+// live on the shard its id hashes to. Id-based operations go to the owning
+// shard and searches are scattered to all shards with the top-k merged here.
+// Errors from a shard are rethrown as std::invalid_argument, as the
+// single-process LibraryManagementSystem would throw them.
+class PartitionedLibrary {
+public:
+    struct SearchHit {
         int id;
-        std::cout << "Enter resource ID to edit: ";
-        std::cin >> id;
+        int score;
+        std::string title;
+    };
+
+    // A loan as the coordinator sees it. Global ids grow with the shard
+    // count, so they are 64-bit where a shard's own Loan ids are int.
+    struct LoanRecord {
+        int64_t id;
+        int userId;
+        int resourceId;
+        Date borrowDate;
+        Date dueDate;
+        Date returnDate;
+        bool returned;
+    };
 
-        auto it = std::find_if(resources.begin(), resources.end(),
-            [id](const std::unique_ptr<Resource>& r) { return r->getId() == id; });
+private:
+    std::vector<ShardChannel> shards;
+    std::vector<pid_t> workers;
+    std::vector<std::string> request;
+    std::vector<std::vector<std::string>> replies;
+    std::vector<std::string> gaugeNames;
+
+    size_t shardOfResource(int resourceId) const {
+        return (static_cast<uint32_t>(resourceId) * 2654435761u >> 16) % shards.size();
+    }
 
-        if (it != resources.end()) {
-            std::string newTitle, newAuthor, newCategory;
-            int newYear;
+    size_t shardOfLoan(int64_t loanId) const { return static_cast<size_t>(loanId % static_cast<int64_t>(shards.size())); }
 
-            std::cout << "Current resource details:" << std::endl;
-            (*it)->displayInfo();
+    static void check(const std::vector<std::string>& reply) {
+        if (reply.at(0) == "error") throw std::invalid_argument(reply.at(1));
+    }
 
-            std::cin.ignore();
-            std::cout << "Enter new title (current: " << (*it)->getTitle() << "): ";
-            std::getline(std::cin, newTitle);
-            if (!newTitle.empty()) (*it)->setTitle(newTitle);
+    const std::vector<std::string>& call(size_t shard) {
+        shards[shard].send(request);
+        if (!shards[shard].receive(replies[shard])) throw std::runtime_error("Shard worker exited");
+        check(replies[shard]);
+        return replies[shard];
+    }
 
-            std::cout << "Enter new author (current: " << (*it)->getAuthor() << "): ";
-            std::getline(std::cin, newAuthor);
-            if (!newAuthor.empty()) (*it)->setAuthor(newAuthor);
+    // Sends the request to every shard before reading any reply, so the
+    // shards work on it concurrently
+    void scatter() {
+        for (auto& shard : shards) shard.send(request);
+        for (size_t s = 0; s < shards.size(); ++s) {
+            if (!shards[s].receive(replies[s])) throw std::runtime_error("Shard worker exited");
+        }
+        for (const auto& reply : replies) check(reply);
+    }
 
-            std::cout << "Enter new publication year (current: " << (*it)->getPublicationYear() << "): ";
-            std::string yearInput;
-            std::getline(std::cin, yearInput);
-            if (!yearInput.empty()) {
-                newYear = std::stoi(yearInput);
-                (*it)->setPublicationYear(newYear);
+public:
+    // Forks the workers; call before this process starts any threads
+    explicit PartitionedLibrary(int shardCount) {
+        if (shardCount < 1) throw std::invalid_argument("Need at least one shard");
+        std::signal(SIGPIPE, SIG_IGN);
+        std::cout.flush();
+        for (int s = 0; s < shardCount; ++s) {
+            int ends[2];
+            if (::socketpair(AF_UNIX, SOCK_STREAM, 0, ends) != 0) throw std::runtime_error("socketpair failed");
+            pid_t pid = ::fork();
+            if (pid < 0) throw std::runtime_error("fork failed");
+            if (pid == 0) {
+                ::close(ends[0]);
+                for (const auto& shard : shards) ::close(shard.descriptor());
+                std::ostream quiet(nullptr);
+                {
+                    ShardWorker worker(ends[1], s, shardCount, quiet);
+                    worker.serve();
+                }
+                ::_exit(0);
             }
-
-            std::cout << "Resource updated successfully!" << std::endl;
-        } else {
-            std::cout << "Resource not found!" << std::endl;
+            ::close(ends[1]);
+            shards.emplace_back(ends[0]);
+            workers.push_back(pid);
         }
+        replies.resize(shards.size());
     }
 
-    void removeResource() {
-        int id;
-        std::cout << "Enter resource ID to remove: ";
-        std::cin >> id;
+    // Closing the sockets ends each worker's serve loop
+    ~PartitionedLibrary() {
+        for (const auto& shard : shards) ::close(shard.descriptor());
+        for (pid_t pid : workers) ::waitpid(pid, nullptr, 0);
+    }
 
-        auto it = std::find_if(resources.begin(), resources.end(),
-            [id](const std::unique_ptr<Resource>& r) { return r->getId() == id; });
+    PartitionedLibrary(const PartitionedLibrary&) = delete;
+    PartitionedLibrary& operator=(const PartitionedLibrary&) = delete;
 
-        if (it != resources.end()) {
-            // Check if resource is currently borrowed
-            bool isBorrowed = std::any_of(loans.begin(), loans.end(),
-                [id](const std::unique_ptr<Loan>& loan) {
-                    return loan->getResourceId() == id && !loan->getIsReturned();
-                });
+    size_t shardCount() const { return shards.size(); }
 
-            if (isBorrowed) {
-                std::cout << "Cannot remove resource - it is currently borrowed!" << std::endl;
-                return;
-            }
+    // Pins the virtual clock here and on every shard (-1 for the wall clock)
+    void setVirtualToday(int dayNumber) {
+        Date::setVirtualToday(dayNumber);
+        request.assign({"today", std::to_string(dayNumber)});
+        scatter();
+    }
 
-            std::cout << "Resource removed: " << (*it)->getTitle() << std::endl;
-            resources.erase(it);
-        } else {
-            std::cout << "Resource not found!" << std::endl;
+    int addUser(const std::string& name, const std::string& email, const std::string& userType) {
+        request.assign({"user", name, email, userType});
+        scatter();
+        return std::stoi(replies[0].at(1));
+    }
+
+    // The resource travels as its JSON record, which keeps its id
+    int addResource(std::shared_ptr<Resource> resource) {
+        const Resource& r = *resource;
+        if (const Book* book = dynamic_cast<const Book*>(&r)) {
+            // ISBNs are unique per shard; ask the others before adding
+            std::string isbn;
+            request.assign({"isbn", std::string(book->getISBN(isbn))});
+            scatter();
+            for (const auto& reply : replies) {
+                if (reply.at(1) != "0") throw std::invalid_argument("ISBN already used by resource " + reply.at(1));
+            }
         }
+        request.assign({"resource", std::string()});
+        r.appendJson(request[1]);
+        return std::stoi(call(shardOfResource(r.getId())).at(1));
     }
 
-    void searchResources() {
-        std::string keyword, category;
-        int choice;
+    LoanRecord borrowResource(int userId, int resourceId) {
+        request.assign({"borrow", std::to_string(userId), std::to_string(resourceId)});
+        const auto& reply = call(shardOfResource(resourceId));
+        Date today;
+        return {std::stoll(reply.at(1)), userId, resourceId, today,
+                Date::fromDayNumber(std::stoi(reply.at(2))), today, false};
+    }
 
-        std::cout << "\n=== Search Resources ===" << std::endl;
-        std::cout << "1. Search by keyword\n2. Search by category\n3. Show all resources" << std::endl;
-        std::cout << "Choose search option: ";
-        std::cin >> choice;
-        std::cin.ignore();
+    void returnResource(int64_t loanId) {
+        request.assign({"return", std::to_string(loanId)});
+        call(shardOfLoan(loanId));
+    }
 
-        std::vector<Resource*> results;
+    Date renewResource(int64_t loanId) {
+        request.assign({"renew", std::to_string(loanId)});
+        return Date::fromDayNumber(std::stoi(call(shardOfLoan(loanId)).at(1)));
+    }
 
-        switch (choice) {
-            case 1:
-                std::cout << "Enter keyword: ";
-                std::getline(std::cin, keyword);
-                for (const auto& resource : resources) {
-                    if (resource->getTitle().find(keyword) != std::string::npos ||
-                        resource->getAuthor().find(keyword) != std::string::npos) {
-                        results.push_back(resource.get());
-                    }
-                }
-                break;
-            case 2:
-                std::cout << "Enter category: ";
-                std::getline(std::cin, category);
-                for (const auto& resource : resources) {
-                    if (resource->getCategory() == category) {
-                        results.push_back(resource.get());
-                    }
-                }
-                break;
-            case 3:
-                for (const auto& resource : resources) {
-                    results.push_back(resource.get());
-                }
-                break;
-            default:
-                std::cout << "Invalid option!" << std::endl;
-                return;
-        }
+    // Returns the global reservation id, or 0 when the user was already queued
+    int64_t reserveResource(int userId, int resourceId) {
+        request.assign({"reserve", std::to_string(userId), std::to_string(resourceId)});
+        return std::stoll(call(shardOfResource(resourceId)).at(1));
+    }
 
-        if (results.empty()) {
-            std::cout << "No resources found!" << std::endl;
-        } else {
-            std::cout << "\nSearch Results (" << results.size() << " found):" << std::endl;
-            std::cout << std::string(80, '-') << std::endl;
-            for (const auto& resource : results) {
-                resource->displayInfo();
-                std::cout << std::string(80, '-') << std::endl;
+    // Each shard returns its own top k; the best k of those are the global top k
+    void searchResources(LibraryManagementSystem::SearchMode mode, const std::string& term, size_t k,
+                         std::vector<SearchHit>& hits) {
+        request.assign({"search", std::to_string(static_cast<int>(mode)), std::to_string(k), term});
+        scatter();
+        hits.clear();
+        for (const auto& reply : replies) {
+            for (size_t i = 1; i + 2 < reply.size(); i += 3) {
+                hits.push_back({std::stoi(reply[i]), std::stoi(reply[i + 1]), reply[i + 2]});
             }
         }
+        size_t n = std::min(k, hits.size());
+        std::partial_sort(hits.begin(), hits.begin() + n, hits.end(), [](const SearchHit& a, const SearchHit& b) {
+            return a.score != b.score ? a.score > b.score : a.id < b.id;
+        });
+        hits.resize(n);
     }
 
-    // User Management
-    void addUser() {
-        std::string name, email, userType;
-
-        std::cout << "\n=== Add New User ===" << std::endl;
-        std::cin.ignore();
-        std::cout << "Enter name: ";
-        std::getline(std::cin, name);
-        std::cout << "Enter email: ";
-        std::getline(std::cin, email);
-        std::cout << "Enter user type (Student/Faculty/Staff): ";
-        std::getline(std::cin, userType);
+    void queryBorrowHistory(int userId, std::vector<LoanRecord>& history) {
+        request.assign({"history", std::to_string(userId)});
+        scatter();
+        history.clear();
+        for (const auto& reply : replies) {
+            for (size_t i = 1; i + 5 < reply.size(); i += 6) {
+                history.push_back({std::stoll(reply[i]), userId, std::stoi(reply[i + 1]),
+                                   Date::fromDayNumber(std::stoi(reply[i + 2])),
+                                   Date::fromDayNumber(std::stoi(reply[i + 3])),
+                                   Date::fromDayNumber(std::stoi(reply[i + 4])), reply[i + 5] == "1"});
+            }
+        }
+        // Global loan ids interleave shards, so order by borrow date instead
+        std::sort(history.begin(), history.end(), [](const LoanRecord& a, const LoanRecord& b) {
+            int dayA = a.borrowDate.toDayNumber(), dayB = b.borrowDate.toDayNumber();
+            return dayA != dayB ? dayA < dayB : a.id < b.id;
+        });
+    }
 
-        users.push_back(std::make_unique<User>(name, email, userType));
-        std::cout << "User added successfully! User ID: " << users.back()->getId() << std::endl;
+    // Returns the number of overdue loans; borrowers are notified on their shard
+    size_t checkOverdueItems() {
+        request.assign({"overdue"});
+        scatter();
+        size_t overdue = 0;
+        for (const auto& reply : replies) overdue += std::stoul(reply.at(1));
+        return overdue;
     }
 
-    void viewUsers() {
-        if (users.empty()) {
-            std::cout << "No users found!" << std::endl;
-            return;
+    // Gauges of one shard, or summed over all shards. Users are replicated,
+    // so their count is taken from a single shard.
+    LibraryMetrics::Gauges collectionGauges(int shard = -1) {
+        request.assign({"gauges"});
+        scatter();
+        if (gaugeNames.empty()) {
+            for (size_t i = 1; i + 1 < replies[0].size(); i += 2) gaugeNames.push_back(replies[0][i]);
         }
-
-        std::cout << "\n=== All Users ===" << std::endl;
-        for (const auto& user : users) {
-            user->displayInfo();
+        LibraryMetrics::Gauges gauges;
+        for (size_t g = 0; g < gaugeNames.size(); ++g) {
+            size_t total = 0;
+            for (size_t s = 0; s < replies.size(); ++s) {
+                if (shard >= 0 ? s == static_cast<size_t>(shard) : gaugeNames[g] != "users" || s == 0) {
+                    total += std::stoul(replies[s].at(2 + 2 * g));
+                }
+            }
+            gauges.emplace_back(gaugeNames[g].c_str(), total);
         }
+        return gauges;
     }
+};
+#endif
+
+// Deterministic circulation replay for macro-benchmarks. A trace is a text
+// file with one operation per line, replayed against LibraryManagementSystem
+// while Date() is pinned to a virtual day:
+//   catalog <users> <resources>   first line: size of the generated catalog
+//   D <day>                       start of a simulated day (0-based)
+//   B|R|N|V <user> <resource>     borrow, return, renew, reserve
+//   S|C <text>                    keyword / category search
+//   H <user>                      borrow history
+//   O                             overdue sweep
+// Returns and renewals name the (user, resource) pair rather than a loan id,
+// so a recorded trace stays valid however ids are assigned.
+class CirculationSimulator {
+public:
+    struct Config {
+        int days = 300;
+        int users = 2000;
+        int resources = 10000;
+        int borrowsPerDay = 300;
+        int searchesPerDay = 40;
+        unsigned seed = 42;
+    };
+
+    struct TraceOp {
+        char code;
+        int user = 0;
+        int resource = 0;
+        std::string text;
+    };
 
-    // Borrowing System
-    void borrowResource() {
-        int userId, resourceId;
+private:
+    static const std::vector<std::string>& topics() {
+        static const std::vector<std::string> words = {
+            "Algorithms", "Databases", "Networks", "Compilers", "Statistics", "Calculus", "Biology",
+            "Chemistry", "Economics", "History", "Philosophy", "Linguistics", "Robotics", "Optics",
+            "Geology", "Ethics", "Thermodynamics", "Topology", "Genetics", "Architecture"};
+        return words;
+    }
 
-        std::cout << "\n=== Borrow Resource ===" << std::endl;
-        std::cout << "Enter user ID: ";
-        std::cin >> userId;
-        std::cout << "Enter resource ID: ";
-        std::cin >> resourceId;
+    static const std::vector<std::string>& categories() {
+        static const std::vector<std::string> names = {
+            "Science", "Engineering", "Mathematics", "Humanities", "Social Sciences", "Medicine"};
+        return names;
+    }
 
-        try {
-            // Validate user
-            auto userIt = std::find_if(users.begin(), users.end(),
-                [userId](const std::unique_ptr<User>& u) { return u->getId() == userId; });
-            if (userIt == users.end()) {
-                throw std::invalid_argument("User not found");
-            }
+    // ISBN-13 with a valid check digit, unique per n
+    static std::string makeIsbn(int n) {
+        std::string digits = "978" + std::to_string(100000000 + n).substr(0, 9);
+        int sum = 0;
+        for (size_t i = 0; i < 12; ++i) sum += (digits[i] - '0') * (i % 2 ? 3 : 1);
+        return digits + static_cast<char>('0' + (10 - sum % 10) % 10);
+    }
 
-            // Validate resource
-            auto resourceIt = std::find_if(resources.begin(), resources.end(),
-                [resourceId](const std::unique_ptr<Resource>& r) { return r->getId() == resourceId; });
-            if (resourceIt == resources.end()) {
-                throw std::invalid_argument("Resource not found");
+public:
+    static std::vector<TraceOp> generate(const Config& config) {
+        struct OpenLoan { int user; int returnDay; int dueDay; };
+
+        std::mt19937 rng(config.seed);
+        auto uniform = [&rng](int lo, int hi) { return std::uniform_int_distribution<int>(lo, hi)(rng); };
+        auto chance = [&rng](double p) { return std::uniform_real_distribution<double>(0, 1)(rng) < p; };
+
+        std::vector<TraceOp> trace;
+        std::unordered_map<int, OpenLoan> onLoan;      // resource -> loan
+        // resource -> user; a returned resource stays held for its reserving
+        // user until the reserved borrow the next day
+        std::unordered_map<int, int> reservedBy;
+        std::vector<std::pair<int, int>> nextDayBorrows;
+
+        for (int day = 0; day < config.days; ++day) {
+            trace.push_back({'D', day, 0, ""});
+
+            for (const auto& borrow : nextDayBorrows) {
+                trace.push_back({'B', borrow.first, borrow.second, ""});
+                onLoan[borrow.second] = {borrow.first, day + uniform(3, 35), day + 14};
+                reservedBy.erase(borrow.second);
             }
-
-            // Check availability
-            if (!(*resourceIt)->getAvailability()) {
-                throw std::invalid_argument("Resource is not available");
+            nextDayBorrows.clear();
+
+            for (auto it = onLoan.begin(); it != onLoan.end();) {
+                int resource = it->first;
+                OpenLoan& loan = it->second;
+                if (loan.returnDay <= day) {
+                    trace.push_back({'R', loan.user, resource, ""});
+                    auto reservation = reservedBy.find(resource);
+                    if (reservation != reservedBy.end()) nextDayBorrows.push_back({reservation->second, resource});
+                    it = onLoan.erase(it);
+                    continue;
+                }
+                // Reserved items cannot be renewed, so patrons do not ask
+                if (loan.dueDay == day && !reservedBy.count(resource) && chance(0.5)) {
+                    trace.push_back({'N', loan.user, resource, ""});
+                    loan.dueDay += 14;
+                }
+                ++it;
             }
 
-            // Create loan
-            loans.push_back(std::make_unique<Loan>(userId, resourceId));
-            (*resourceIt)->setAvailability(false);
+            for (int i = 0; i < config.borrowsPerDay; ++i) {
+                int user = uniform(1, config.users);
+                int resource = uniform(1, config.resources);
+                if (reservedBy.count(resource)) continue;  // already reserved, or held for a reservation
+                auto loan = onLoan.find(resource);
+                if (loan == onLoan.end()) {
+                    trace.push_back({'B', user, resource, ""});
+                    onLoan[resource] = {user, day + uniform(3, 35), day + 14};
+                } else if (loan->second.user != user && chance(0.3)) {
+                    trace.push_back({'V', user, resource, ""});
+                    reservedBy[resource] = user;
+                }
+            }
 
-            std::cout << "Resource borrowed successfully!" << std::endl;
-            std::cout << "Due date: " << loans.back()->getDueDate() << std::endl;
+            for (int i = 0; i < config.searchesPerDay; ++i) {
+                switch (uniform(0, 2)) {
+                    case 0: trace.push_back({'S', 0, 0, topics()[uniform(0, static_cast<int>(topics().size()) - 1)]}); break;
+                    case 1: trace.push_back({'C', 0, 0, categories()[uniform(0, static_cast<int>(categories().size()) - 1)]}); break;
+                    default: trace.push_back({'H', uniform(1, config.users), 0, ""}); break;
+                }
+            }
 
-            // Add notification
-            notifications.push_back(Notification(
-                "Resource borrowed: " + (*resourceIt)->getTitle(), "borrow"));
+            trace.push_back({'O', 0, 0, ""});
+        }
+        return trace;
+    }
 
-        } catch (const std::exception& e) {
-            std::cout << "Error borrowing resource: " << e.what() << std::endl;
+    static void save(const std::string& filename, const Config& config, const std::vector<TraceOp>& trace) {
+        std::ofstream out(filename);
+        if (!out) throw std::runtime_error("Cannot open " + filename + " for writing");
+        out << "catalog " << config.users << " " << config.resources << "\n";
+        for (const auto& op : trace) {
+            out << op.code;
+            switch (op.code) {
+                case 'D': case 'H': out << " " << op.user; break;
+                case 'S': case 'C': out << " " << op.text; break;
+                case 'O': break;
+                default: out << " " << op.user << " " << op.resource; break;
+            }
+            out << "\n";
         }
     }
 
-    void returnResource() {
-        int loanId;
-        std::cout << "\n=== Return Resource ===" << std::endl;
-        std::cout << "Enter loan ID: ";
-        std::cin >> loanId;
+    static std::vector<TraceOp> load(const std::string& filename, Config& config) {
+        std::ifstream in(filename);
+        if (!in) throw std::runtime_error("Cannot open " + filename);
+        std::string header;
+        in >> header >> config.users >> config.resources;
+        if (header != "catalog") throw std::runtime_error("Trace must start with a catalog line");
+
+        std::vector<TraceOp> trace;
+        std::string line;
+        std::getline(in, line);
+        while (std::getline(in, line)) {
+            if (line.empty()) continue;
+            TraceOp op{line[0], 0, 0, ""};
+            std::istringstream fields(line.substr(1));
+            switch (op.code) {
+                case 'D': case 'H': fields >> op.user; break;
+                case 'S': case 'C': op.text = line.size() > 2 ? line.substr(2) : ""; break;
+                case 'O': break;
+                case 'B': case 'R': case 'N': case 'V': fields >> op.user >> op.resource; break;
+                default: throw std::runtime_error("Unknown trace operation: " + line);
+            }
+            trace.push_back(op);
+        }
+        config.days = 0;
+        for (const auto& op : trace) {
+            if (op.code == 'D') config.days = std::max(config.days, op.user + 1);
+        }
+        return trace;
+    }
 
-        auto loanIt = std::find_if(loans.begin(), loans.end(),
-            [loanId](const std::unique_ptr<Loan>& l) { return l->getId() == loanId; });
+private:
+#if LMS_COUNT_ALLOCATIONS
+    // Runs each read-only query path repeatedly with warmed-up buffers and
+    // prints the heap allocations per query. Returns false if any of them
+    // allocated. Sampled tracing allocates its event buffers, so it is
+    // paused meanwhile.
+    static bool reportQueryAllocations(LibraryManagementSystem& library) {
+        const int Rounds = 100;
+        uint32_t sampleRate = Tracer::instance().sampleRate();
+        Tracer::instance().setSampleRate(0);
+
+        std::shared_ptr<const LibrarySnapshot> snapshot = library.pinSnapshot();
+        std::vector<const Resource*> foundResources;
+        std::vector<Loan> history;
+        std::vector<const Reservation*> reservations;
+        std::vector<CoBorrowIndex::Recommendation> recommendations;
+        const std::string isbn = makeIsbn(1);
+        const std::string email = "Patron1@University.edu";
+
+        std::vector<std::pair<const char*, std::function<void()>>> probes = {
+            {"keyword search", [&] { library.queryResources(*snapshot, LibraryManagementSystem::SearchMode::Keyword,
+                                                            topics()[0], foundResources); }},
+            {"category search", [&] { library.queryResources(*snapshot, LibraryManagementSystem::SearchMode::Category,
+                                                             categories()[0], foundResources); }},
+            {"isbn lookup", [&] { library.findResourceByIsbn(isbn); }},
+            {"email lookup", [&] { library.findUserByEmail(email); }},
+            {"borrow history", [&] { library.queryBorrowHistory(*snapshot, 1, history); }},
+            {"reservations", [&] { library.queryReservations(*snapshot, 1, reservations); }},
+            {"also borrowed", [&] { library.alsoBorrowed(1, 10, recommendations); }},
+        };
+
+        bool heapFree = true;
+        std::cout << "Heap allocations per query:";
+        for (auto& probe : probes) {
+            probe.second();
+            uint64_t before = heapAllocationCount.load(std::memory_order_relaxed);
+            for (int i = 0; i < Rounds; ++i) probe.second();
+            uint64_t allocations = heapAllocationCount.load(std::memory_order_relaxed) - before;
+            std::cout << " " << probe.first << " " << static_cast<double>(allocations) / Rounds << ";";
+            if (allocations > 0) heapFree = false;
+        }
+        std::cout << std::endl;
+        if (!heapFree) std::cout << "Error: a query path allocated on the heap" << std::endl;
+        Tracer::instance().setSampleRate(sampleRate);
+        return heapFree;
+    }
+#endif
+
+    // Times keyword and category scans of the final catalog with 1, 2, 4, ...
+    // threads up to the hardware's, then restores the default pool
+    static void reportScanScaling(LibraryManagementSystem& library) {
+        const int Rounds = 10;
+        size_t defaultThreads = library.scanThreads();
+        size_t hardware = std::max(1u, std::thread::hardware_concurrency());
+        std::shared_ptr<const LibrarySnapshot> snapshot = library.pinSnapshot();
+        std::vector<const Resource*> found;
+
+        std::cout << "\nScan scaling over " << snapshot->resources.size() << " resources (" << hardware
+                  << " hardware threads), ms per scan\n"
+                  << std::left << std::setw(10) << "threads" << std::right << std::setw(12) << "keyword"
+                  << std::setw(12) << "category" << std::setw(12) << "speedup" << std::endl;
+        double single = 0;
+        for (size_t threads = 1;; threads = std::min(threads * 2, hardware)) {
+            library.setScanThreads(threads);
+            auto time = [&](LibraryManagementSystem::SearchMode mode, const std::vector<std::string>& terms) {
+                library.queryResources(*snapshot, mode, terms[0], found);  // warm the buffers
+                auto start = std::chrono::steady_clock::now();
+                for (int i = 0; i < Rounds; ++i) library.queryResources(*snapshot, mode, terms[i % terms.size()], found);
+                return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count() / Rounds;
+            };
+            double keyword = time(LibraryManagementSystem::SearchMode::Keyword, topics());
+            double category = time(LibraryManagementSystem::SearchMode::Category, categories());
+            if (threads == 1) single = keyword + category;
+
+            std::ostringstream row;
+            row << std::fixed << std::setprecision(2) << std::setw(12) << keyword << std::setw(12) << category
+                << std::setw(11) << single / (keyword + category) << "x";
+            std::cout << std::left << std::setw(10) << threads << std::right << row.str() << std::endl;
+            if (threads == hardware) break;
+        }
+        library.setScanThreads(defaultThreads);
+    }
 
-        if (loanIt != loans.end() && !(*loanIt)->getIsReturned()) {
-            (*loanIt)->returnResource();
+    // Generated catalog shared by every backend
+    template <typename Library>
+    static void populate(Library& library, const Config& config) {
+        for (int u = 1; u <= config.users; ++u) {
+            library.addUser("Patron " + std::to_string(u), "patron" + std::to_string(u) + "@university.edu",
+                            u % 10 == 0 ? "Faculty" : "Student");
+        }
+        const auto& words = topics();
+        const auto& cats = categories();
+        for (int r = 1; r <= config.resources; ++r) {
+            const std::string& topic = words[r % words.size()];
+            std::string title = (r % 3 == 0 ? "Introduction to " : r % 3 == 1 ? "Advanced " : "Proceedings of ")
+                                + topic + " Vol. " + std::to_string(r / static_cast<int>(words.size()));
+            library.addResource(std::make_shared<Book>(title, "Author " + std::to_string(r % 997),
+                                                       1950 + r % 75, cats[r % cats.size()], makeIsbn(r),
+                                                       100 + r % 900));
+        }
+    }
 
-            // Make resource available
-            int resourceId = (*loanIt)->getResourceId();
-            auto resourceIt = std::find_if(resources.begin(), resources.end(),
-                [resourceId](const std::unique_ptr<Resource>& r) { return r->getId() == resourceId; });
-            if (resourceIt != resources.end()) {
-                (*resourceIt)->setAvailability(true);
-            }
+    // Query buffers reused across the replay
+    struct Buffers {
+        std::vector<const Resource*> foundResources;
+        std::vector<Loan> history;
+        std::vector<const Loan*> overdue;
+#if LMS_HAS_SHARDS
+        std::vector<PartitionedLibrary::SearchHit> hits;
+        std::vector<PartitionedLibrary::LoanRecord> loans;
+#endif
+    };
+
+    // The read paths differ per backend: a single process queries a pinned
+    // snapshot, a partitioned catalog scatters to its shards
+    static void setToday(LibraryManagementSystem&, int dayNumber) { Date::setVirtualToday(dayNumber); }
+
+    static int64_t borrow(LibraryManagementSystem& library, int userId, int resourceId) {
+        return library.borrowResource(userId, resourceId).getId();
+    }
 
-            std::cout << "Resource returned successfully!" << std::endl;
+    static void search(LibraryManagementSystem& library, LibraryManagementSystem::SearchMode mode,
+                       const std::string& term, Buffers& buffers) {
+        library.queryResources(*library.pinSnapshot(), mode, term, buffers.foundResources);
+    }
 
-            // Check for reservations
-            checkReservations(resourceId);
+    static void history(LibraryManagementSystem& library, int userId, Buffers& buffers) {
+        library.queryBorrowHistory(*library.pinSnapshot(), userId, buffers.history);
+    }
 
-        } else {
-            std::cout << "Loan not found or already returned!" << std::endl;
-        }
+    static void overdue(LibraryManagementSystem& library, Buffers& buffers) {
+        library.checkOverdueItems(*library.pinSnapshot(), Date(), buffers.overdue);
     }
 
-    void renewResource() {
-        int loanId;
-        std::cout << "\n=== Renew Resource ===" << std::endl;
-        std::cout << "Enter loan ID: ";
-        std::cin >> loanId;
+#if LMS_HAS_SHARDS
+    static constexpr size_t SearchLimit = 10;
 
-        auto loanIt = std::find_if(loans.begin(), loans.end(),
-            [loanId](const std::unique_ptr<Loan>& l) { return l->getId() == loanId; });
+    static void setToday(PartitionedLibrary& library, int dayNumber) { library.setVirtualToday(dayNumber); }
 
-        if (loanIt != loans.end() && !(*loanIt)->getIsReturned()) {
-            // Check if there are reservations for this resource
-            int resourceId = (*loanIt)->getResourceId();
-            bool hasReservation = std::any_of(reservations.begin(), reservations.end(),
-                [resourceId](const std::unique_ptr<Reservation>& r) {
-                    return r->getResourceId() == resourceId && r->getIsActive();
-                });
+    static int64_t borrow(PartitionedLibrary& library, int userId, int resourceId) {
+        return library.borrowResource(userId, resourceId).id;
+    }
 
-            if (hasReservation) {
-                std::cout << "Cannot renew - resource has reservations!" << std::endl;
-            } else {
-                (*loanIt)->extendDueDate(14);
-                std::cout << "Resource renewed successfully!" << std::endl;
-                std::cout << "New due date: " << (*loanIt)->getDueDate() << std::endl;
-            }
-        } else {
-            std::cout << "Loan not found or already returned!" << std::endl;
-        }
+    static void search(PartitionedLibrary& library, LibraryManagementSystem::SearchMode mode,
+                       const std::string& term, Buffers& buffers) {
+        library.searchResources(mode, term, SearchLimit, buffers.hits);
     }
 
-    void viewBorrowHistory() {
-        int userId;
-        std::cout << "Enter user ID: ";
-        std::cin >> userId;
+    static void history(PartitionedLibrary& library, int userId, Buffers& buffers) {
+        library.queryBorrowHistory(userId, buffers.loans);
+    }
 
-        std::cout << "\n=== Borrow History for User " << userId << " ===" << std::endl;
-        bool found = false;
-        for (const auto& loan : loans) {
-            if (loan->getUserId() == userId) {
-                loan->displayInfo();
-                found = true;
+    static void overdue(PartitionedLibrary& library, Buffers&) { library.checkOverdueItems(); }
+#endif
+
+    // Replays the trace and prints one line of throughput and memory per
+    // simulated month. RSS adds up this process and any shard workers.
+    template <typename Library>
+    static void replay(Library& library, const Config& config, const std::vector<TraceOp>& trace) {
+        const int firstDay = Date(1, 9, 2026).toDayNumber();
+        setToday(library, firstDay);
+        populate(library, config);
+
+        // Day markers ('D') only move the clock and are not counted as operations
+        size_t operations = static_cast<size_t>(std::count_if(trace.begin(), trace.end(),
+                                                              [](const TraceOp& op) { return op.code != 'D'; }));
+        std::cout << "Simulating " << config.days << " days: " << config.users << " users, "
+                  << config.resources << " resources, " << operations << " operations" << std::endl;
+        std::cout << std::left << std::setw(8) << "day" << std::right << std::setw(12) << "ops"
+                  << std::setw(14) << "ops/s" << std::setw(14) << "active" << std::setw(14) << "archived"
+                  << std::setw(16) << "notifications" << std::setw(12) << "RSS MB" << std::endl;
+
+        std::map<int, int64_t> loanFor;  // resource -> active loan id
+        Buffers buffers;
+        size_t failures = 0, opsInPeriod = 0, totalOps = 0;
+        auto periodStart = std::chrono::steady_clock::now();
+        auto runStart = periodStart;
+        auto report = [&](int day) {
+            auto now = std::chrono::steady_clock::now();
+            double seconds = std::chrono::duration<double>(now - periodStart).count();
+            LibraryMetrics::Gauges gauges = library.collectionGauges();
+            auto gauge = [&gauges](const char* name) {
+                for (const auto& g : gauges) if (std::string(g.first) == name) return g.second;
+                return size_t(0);
+            };
+            std::cout << std::left << std::setw(8) << day << std::right << std::setw(12) << opsInPeriod
+                      << std::setw(14) << static_cast<uint64_t>(seconds > 0 ? opsInPeriod / seconds : 0)
+                      << std::setw(14) << gauge("active_loans") << std::setw(14) << gauge("archived_loans")
+                      << std::setw(16) << gauge("notifications")
+                      << std::setw(12) << (residentBytes() + gauge("resident_bytes")) / (1024 * 1024) << std::endl;
+            opsInPeriod = 0;
+            periodStart = now;
+        };
+
+        for (const auto& op : trace) {
+            try {
+                switch (op.code) {
+                    case 'D':
+                        if (op.user > 0 && op.user % 30 == 0) report(op.user);
+                        setToday(library, firstDay + op.user);
+                        continue;
+                    case 'B':
+                        loanFor[op.resource] = borrow(library, op.user, op.resource);
+                        break;
+                    case 'R': {
+                        auto it = loanFor.find(op.resource);
+                        if (it == loanFor.end()) throw std::invalid_argument("No active loan");
+                        library.returnResource(it->second);
+                        loanFor.erase(it);
+                        break;
+                    }
+                    case 'N': {
+                        auto it = loanFor.find(op.resource);
+                        if (it == loanFor.end()) throw std::invalid_argument("No active loan");
+                        library.renewResource(it->second);
+                        break;
+                    }
+                    case 'V':
+                        library.reserveResource(op.user, op.resource);
+                        break;
+                    case 'S':
+                    case 'C':
+                        search(library, op.code == 'S' ? LibraryManagementSystem::SearchMode::Keyword
+                                                       : LibraryManagementSystem::SearchMode::Category,
+                               op.text, buffers);
+                        break;
+                    case 'H':
+                        history(library, op.user, buffers);
+                        break;
+                    case 'O':
+                        overdue(library, buffers);
+                        break;
+                }
+            } catch (const std::invalid_argument&) {
+                ++failures;
             }
+            ++opsInPeriod;
+            ++totalOps;
         }
+        report(config.days);
+
+        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - runStart).count();
+        std::ostringstream elapsed;
+        elapsed << std::fixed << std::setprecision(2) << seconds;
+        std::cout << "\n" << totalOps << " operations in " << elapsed.str()
+                  << " s (" << static_cast<uint64_t>(totalOps / seconds) << " ops/s), "
+                  << failures << " rejected" << std::endl;
+    }
 
-        if (!found) {
-            std::cout << "No borrow history found for this user!" << std::endl;
+#if LMS_HAS_SMTP
+    // Checks that the mock server received exactly the notices reported as
+    // delivered, one email per batch; returns false when they differ
+    static bool reportDelivery(const LibraryManagementSystem& library, const MockSmtpServer& smtp) {
+        NotificationDispatcher::Counters sent = library.deliveryCounters();
+        std::vector<MockSmtpServer::Message> emails = smtp.messages();
+        size_t notices = 0;
+        std::unordered_map<std::string, size_t> patrons;
+        for (const auto& email : emails) {
+            ++patrons[email.recipient];
+            size_t body = email.data.find("\n\n");
+            if (body != std::string::npos) notices += std::count(email.data.begin() + body + 2, email.data.end(), '\n');
         }
+        std::cout << "Notification delivery: " << sent.enqueued << " queued, " << sent.delivered << " delivered in "
+                  << sent.batches << " emails, " << sent.retries << " retries, " << sent.dropped << " dropped" << std::endl;
+        std::cout << "Mock SMTP server received " << emails.size() << " emails with " << notices << " notices for "
+                  << patrons.size() << " patrons" << std::endl;
+
+        bool matches = sent.delivered == notices && sent.batches == emails.size() &&
+                       sent.enqueued == sent.delivered + sent.dropped;
+        if (!matches) std::cout << "Error: delivered notifications do not match what the mail server received" << std::endl;
+        return matches;
     }
+#endif
 
-    // Reservation System
-    void reserveResource() {
-        int userId, resourceId;
-
-        std::cout << "\n=== Reserve Resource ===" << std::endl;
-        std::cout << "Enter user ID: ";
-        std::cin >> userId;
-        std::cout << "Enter resource ID: ";
-        std::cin >> resourceId;
+public:
+    // Returns false when a check on the run failed
+    static bool run(const Config& config, const std::vector<TraceOp>& trace) {
+        bool passed = true;
+        std::ostream quiet(nullptr);
+#if LMS_HAS_SMTP
+        // Patrons' notices go by email to a local mock server that defers one
+        // transaction in 20, so batching, retries and backoff all take part
+        MockSmtpServer smtp(20);
+#endif
+        LibraryManagementSystem library;
+        library.setConsole(quiet);
+#if LMS_HAS_SMTP
+        NotificationDispatcher::Config delivery;
+        delivery.batchWindow = std::chrono::milliseconds(20);
+        delivery.sendsPerSecond = 20000;
+        delivery.burst = 100;
+        delivery.initialBackoff = std::chrono::milliseconds(5);
+        library.startNotificationDelivery(std::make_shared<SmtpSink>("127.0.0.1", smtp.port(), "library@university.edu"),
+                                          delivery);
+#endif
+        replay(library, config, trace);
+#if LMS_HAS_SMTP
+        library.flushNotifications();
+        if (!reportDelivery(library, smtp)) passed = false;
+#endif
+
+        // Recommendations for part of the catalog, so their latency shows in the statistics
+        std::vector<CoBorrowIndex::Recommendation> recommendations;
+        for (int r = 1; r <= std::min(config.resources, 1000); ++r) library.alsoBorrowed(r, 10, recommendations);
+#if LMS_COUNT_ALLOCATIONS
+        if (!reportQueryAllocations(library)) passed = false;
+#endif
+        library.viewStatistics();
+        reportScanScaling(library);
+        Date::setVirtualToday(-1);
+        return passed;
+    }
 
-        try {
-            // Validate user and resource
-            auto userIt = std::find_if(users.begin(), users.end(),
-                [userId](const std::unique_ptr<User>& u) { return u->getId() == userId; });
-            if (userIt == users.end()) {
-                throw std::invalid_argument("User not found");
-            }
+#if LMS_HAS_SHARDS
+    // Replays the trace against a catalog partitioned over worker processes,
+    // then prints how the collection spread over the shards and checks the
+    // merged top-k of every generated search against a single process.
+    // Returns false when the merged search results differ from a single process
+    static bool runPartitioned(const Config& config, const std::vector<TraceOp>& trace, int shardCount) {
+        PartitionedLibrary library(shardCount);
+        replay(library, config, trace);
+
+        std::cout << "\n" << std::left << std::setw(8) << "shard" << std::right << std::setw(12) << "resources"
+                  << std::setw(14) << "active" << std::setw(14) << "archived" << std::setw(12) << "RSS MB" << std::endl;
+        for (int s = 0; s < shardCount; ++s) {
+            LibraryMetrics::Gauges gauges = library.collectionGauges(s);
+            auto gauge = [&gauges](const char* name) {
+                for (const auto& g : gauges) if (std::string(g.first) == name) return g.second;
+                return size_t(0);
+            };
+            std::cout << std::left << std::setw(8) << s << std::right << std::setw(12) << gauge("resources")
+                      << std::setw(14) << gauge("active_loans") << std::setw(14) << gauge("archived_loans")
+                      << std::setw(12) << gauge("resident_bytes") / (1024 * 1024) << std::endl;
+        }
+        std::cout << std::left << std::setw(8) << "coord" << std::right << std::setw(52)
+                  << residentBytes() / (1024 * 1024) << std::endl;
+
+        // Search results do not depend on circulation, so the same catalog
+        // built in this process gives the expected top-k
+        std::ostream quiet(nullptr);
+        LibraryManagementSystem reference;
+        reference.setConsole(quiet);
+        Resource::setNextId(1);
+        populate(reference, config);
+        std::shared_ptr<const LibrarySnapshot> snapshot = reference.pinSnapshot();
+
+        std::vector<std::pair<LibraryManagementSystem::SearchMode, std::string>> queries;
+        for (const auto& word : topics()) queries.push_back({LibraryManagementSystem::SearchMode::Keyword, word});
+        for (const auto& name : categories()) queries.push_back({LibraryManagementSystem::SearchMode::Category, name});
+        queries.push_back({LibraryManagementSystem::SearchMode::Keyword, "Vol. 1"});
+
+        std::vector<PartitionedLibrary::SearchHit> hits;
+        std::vector<const Resource*> expected;
+        size_t matching = 0;
+        std::string title;
+        for (const auto& query : queries) {
+            library.searchResources(query.first, query.second, SearchLimit, hits);
+            reference.topResources(*snapshot, query.first, query.second, SearchLimit, expected);
+            bool same = hits.size() == expected.size() &&
+                std::equal(hits.begin(), hits.end(), expected.begin(),
+                    [&title](const PartitionedLibrary::SearchHit& hit, const Resource* resource) {
+                        return hit.id == resource->getId() && hit.title == resource->getTitle(title);
+                    });
+            if (same) ++matching;
+        }
+        std::cout << "Merged top-" << SearchLimit << " search matches a single process for " << matching << " of "
+                  << queries.size() << " queries" << std::endl;
+        bool passed = matching == queries.size();
+        if (!passed) std::cout << "Error: merged shard search results differ from a single process" << std::endl;
+        Date::setVirtualToday(-1);
+        return passed;
+    }
+#endif
+};
 
-            auto resourceIt = std::find_if(resources.begin(), resources.end(),
-                [resourceId](const std::unique_ptr<Resource>& r) { return r->getId() == resourceId; });
-            if (resourceIt == resources.end()) {
-                throw std::invalid_argument("Resource not found");
+// Serialization throughput of the schema codecs over a generated catalog
+// mixing all resource types. Each codec encodes the catalog into one buffer
+// and decodes it back; the decoded records must re-encode to the same bytes.
+// Rows built by string concatenation, as Resource::toCSV() did before the
+// schemas, are timed alongside as the baseline.
+class CodecBenchmark {
+private:
+    static constexpr int Rounds = 3;
+
+    struct Result {
+        const char* name;
+        size_t bytes = 0;
+        double encodeNs = 0;  // best round, per record
+        double decodeNs = 0;
+        bool roundTrip = true;
+        bool decodes = true;
+    };
+
+    static std::vector<ResourceRecord> catalog(size_t count) {
+        static const char* const topics[] = {"Algorithms", "Databases", "Networks", "Compilers", "Graphics", "Robotics"};
+        std::vector<ResourceRecord> records;
+        records.reserve(count);
+        for (size_t i = 0; i < count; ++i) {
+            int n = static_cast<int>(i);
+            std::string topic = topics[i % 6];
+            // Some titles need quoting in CSV and escaping in JSON
+            std::string title = i % 7 == 0 ? topic + ", \"Selected Papers\" Vol. " + std::to_string(n)
+                                           : "Introduction to " + topic + " Vol. " + std::to_string(n);
+            std::string author = "Author " + std::to_string(n % 997);
+            switch (i % 4) {
+                case 0: records.emplace_back(Book(title, author, 1950 + n % 75, "Computer Science",
+                                                  "978" + std::to_string(1000000000 + n), 100 + n % 900)); break;
+                case 1: records.emplace_back(Article(title, author, 1950 + n % 75, "Engineering",
+                                                     "Journal of " + topic, 1 + n % 60)); break;
+                case 2: records.emplace_back(Thesis(title, author, 1950 + n % 75, "Mathematics", "PhD",
+                                                    "University " + std::to_string(n % 113))); break;
+                default: records.emplace_back(DigitalContent(title, author, 1950 + n % 75, "Physics", "PDF",
+                                                             0.5 + (n % 400) * 0.25)); break;
             }
+        }
+        return records;
+    }
 
-            // Check if resource is available
-            if ((*resourceIt)->getAvailability()) {
-                std::cout << "Resource is available - you can borrow it directly!" << std::endl;
-                return;
+    // The pre-schema CSV row: concatenation with std::to_string, no quoting
+    static std::string legacyCsv(const ResourceRecord& record) {
+        return std::visit([](const auto& r) {
+            using R = std::decay_t<decltype(r)>;
+            std::string title, author, category, own, other;
+            std::string csv = std::to_string(r.getId());
+            csv.append(",").append(r.getType()).append(",").append(r.getTitle(title)).append(",").append(r.getAuthor(author))
+               .append(",").append(std::to_string(r.getPublicationYear())).append(",").append(r.getCategory(category))
+               .append(r.getAvailability() ? ",1" : ",0");
+            if constexpr (std::is_same_v<R, Book>) {
+                return csv + "," + std::string(r.getISBN(own)) + "," + std::to_string(r.getPages());
+            } else if constexpr (std::is_same_v<R, Article>) {
+                return csv + "," + std::string(r.getJournal(own)) + "," + std::to_string(r.getVolume());
+            } else if constexpr (std::is_same_v<R, Thesis>) {
+                return csv + "," + std::string(r.getDegree(own)) + "," + std::string(r.getUniversity(other));
+            } else {
+                return csv + "," + std::string(r.getFormat(own)) + "," + std::to_string(r.getFileSize());
             }
+        }, record);
+    }
 
-            // Check if user already has a reservation for this resource
-            bool alreadyReserved = std::any_of(reservations.begin(), reservations.end(),
-                [userId, resourceId](const std::unique_ptr<Reservation>& r) {
-                    return r->getUserId() == userId && r->getResourceId() == resourceId && r->getIsActive();
-                });
+    // Best of Rounds, in nanoseconds per record
+    template <typename Body>
+    static double timeRounds(size_t count, Body body) {
+        double best = 0;
+        for (int round = 0; round < Rounds; ++round) {
+            auto start = std::chrono::steady_clock::now();
+            body();
+            double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            if (round == 0 || ns < best) best = ns;
+        }
+        return best / static_cast<double>(count);
+    }
 
-            if (alreadyReserved) {
-                throw std::invalid_argument("You already have a reservation for this resource");
+    // Newline-terminated text records (CSV rows, JSON objects)
+    template <typename Codec>
+    static Result textCodec(const char* name, const std::vector<ResourceRecord>& records) {
+        Result result{name};
+        std::string buffer;
+        result.encodeNs = timeRounds(records.size(), [&] {
+            buffer.clear();
+            for (const auto& record : records) {
+                Codec::encode(record, buffer);
+                buffer.push_back('\n');
             }
+        });
+        result.bytes = buffer.size();
+
+        std::vector<ResourceRecord> decoded;
+        decoded.reserve(records.size());
+        result.decodeNs = timeRounds(records.size(), [&] {
+            decoded.clear();
+            std::string_view rest = buffer;
+            while (!rest.empty()) {
+                size_t end = rest.find('\n');
+                decoded.push_back(Codec::decode(rest.substr(0, end)));
+                rest.remove_prefix(end + 1);
+            }
+        });
 
-            reservations.push_back(std::make_unique<Reservation>(userId, resourceId));
-            std::cout << "Resource reserved successfully!" << std::endl;
-
-        } catch (const std::exception& e) {
-            std::cout << "Error reserving resource: " << e.what() << std::endl;
+        std::string again;
+        for (const auto& record : decoded) {
+            Codec::encode(record, again);
+            again.push_back('\n');
         }
+        result.roundTrip = again == buffer;
+        return result;
     }
 
-    void viewReservations() {
-        int userId;
-        std::cout << "Enter user ID: ";
-        std::cin >> userId;
+    static Result binaryCodec(const std::vector<ResourceRecord>& records) {
+        Result result{"binary"};
+        std::string buffer;
+        result.encodeNs = timeRounds(records.size(), [&] {
+            buffer.clear();
+            for (const auto& record : records) BinaryCodec::encode(record, buffer);
+        });
+        result.bytes = buffer.size();
+
+        std::vector<ResourceRecord> decoded;
+        decoded.reserve(records.size());
+        result.decodeNs = timeRounds(records.size(), [&] {
+            decoded.clear();
+            size_t offset = 0;
+            while (offset < buffer.size()) decoded.push_back(BinaryCodec::decode(buffer, offset));
+        });
+
+        std::string again;
+        for (const auto& record : decoded) BinaryCodec::encode(record, again);
+        result.roundTrip = again == buffer;
+        return result;
+    }
 
-        std::cout << "\n=== Reservations for User " << userId << " ===" << std::endl;
-        bool found = false;
-        for (const auto& reservation : reservations) {
-            if (reservation->getUserId() == userId && reservation->getIsActive()) {
-                reservation->displayInfo();
-                found = true;
+public:
+    // Returns false when a codec did not round-trip its records
+    static bool run(size_t count) {
+        if (count == 0) throw std::invalid_argument("Record count must be positive");
+        std::vector<ResourceRecord> records = catalog(count);
+        std::vector<std::shared_ptr<Resource>> resources;
+        resources.reserve(count);
+        for (const auto& record : records) resources.push_back(makeResource(ResourceRecord(record)));
+
+        std::vector<Result> results;
+        results.push_back(textCodec<CsvCodec>("csv", records));
+        results.push_back(binaryCodec(records));
+        results.push_back(textCodec<JsonCodec>("json", records));
+
+        // Encoding through the Resource interface, one virtual call per record
+        Result virtualCsv{"csv (virtual)"};
+        std::string buffer;
+        virtualCsv.encodeNs = timeRounds(count, [&] {
+            buffer.clear();
+            for (const auto& resource : resources) {
+                resource->appendCsv(buffer);
+                buffer.push_back('\n');
             }
+        });
+        virtualCsv.bytes = buffer.size();
+        virtualCsv.decodes = false;
+        results.push_back(virtualCsv);
+
+        Result legacy{"csv (concat)"};
+        legacy.encodeNs = timeRounds(count, [&] {
+            buffer.clear();
+            for (const auto& record : records) buffer.append(legacyCsv(record)).push_back('\n');
+        });
+        legacy.bytes = buffer.size();
+        legacy.decodes = false;
+        results.push_back(legacy);
+
+        auto mbPerSecond = [](size_t bytes, double nsPerRecord, size_t records) {
+            return static_cast<double>(bytes) / (nsPerRecord * static_cast<double>(records)) * 1e3;
+        };
+        std::cout << count << " records (mixed types), best of " << Rounds << " rounds\n"
+                  << std::left << std::setw(16) << "codec" << std::right << std::setw(12) << "bytes/rec"
+                  << std::setw(14) << "encode ns" << std::setw(12) << "MB/s" << std::setw(14) << "decode ns"
+                  << std::setw(12) << "MB/s" << std::setw(12) << "roundtrip" << std::endl;
+        std::cout << std::fixed << std::setprecision(1);
+        for (const auto& r : results) {
+            std::cout << std::left << std::setw(16) << r.name << std::right
+                      << std::setw(12) << static_cast<double>(r.bytes) / static_cast<double>(count)
+                      << std::setw(14) << r.encodeNs << std::setw(12) << mbPerSecond(r.bytes, r.encodeNs, count);
+            if (r.decodes) {
+                std::cout << std::setw(14) << r.decodeNs << std::setw(12) << mbPerSecond(r.bytes, r.decodeNs, count)
+                          << std::setw(12) << (r.roundTrip ? "ok" : "MISMATCH");
+            } else {
+                std::cout << std::setw(14) << "-" << std::setw(12) << "-" << std::setw(12) << "-";
+            }
+            std::cout << std::endl;
         }
+        std::cout.unsetf(std::ios::floatfield);
+        std::cout << std::setprecision(6);
 
-        if (!found) {
-            std::cout << "No active reservations found for this user!" << std::endl;
+        for (const auto& r : results) {
+            if (r.decodes && !r.roundTrip) {
+                std::cout << "Error: the " << r.name << " codec did not round-trip its records" << std::endl;
+                return false;
+            }
         }
+        return true;
     }
+};
 
-    void checkReservations(int resourceId) {
-        auto reservationIt = std::find_if(reservations.begin(), reservations.end(),
-            [resourceId](const std::unique_ptr<Reservation>& r) {
-                return r->getResourceId() == resourceId && r->getIsActive();
-            });
-
-        if (reservationIt != reservations.end()) {
-            int userId = (*reservationIt)->getUserId();
-            auto userIt = std::find_if(users.begin(), users.end(),
-                [userId](const std::unique_ptr<User>& u) { return u->getId() == userId; });
-
-            if (userIt != users.end()) {
-                std::cout << "Notifying user " << (*userIt)->getName() 
-                         << " that reserved resource is now available!" << std::endl;
-                notifications.push_back(Notification(
-                    "Reserved resource is now available", "available"));
+// Main function
+int main(int argc, char* argv[]) {
+    // Command-line modes: --simulate [days] [--seed n] [--users n] [--resources n]
+    //                     [--record file] [--replay file] [--shards n]
+    //                     --bench-codecs [records] (on its own)
+    std::vector<std::string> args(argv + 1, argv + argc);
+    if (!args.empty()) {
+        int status = 0;
+        try {
+            CirculationSimulator::Config config;
+            std::string recordFile, replayFile;
+            bool simulate = false;
+            bool simulationOption = false;  // only meaningful with --simulate or --replay
+            int shards = 0;
+            size_t benchRecords = 0;
+            for (size_t i = 0; i < args.size(); ++i) {
+                bool hasValue = i + 1 < args.size();
+                if (args[i] == "--simulate") {
+                    simulate = true;
+                    if (hasValue && std::isdigit(static_cast<unsigned char>(args[i + 1][0]))) config.days = std::stoi(args[++i]);
+                } else if (args[i] == "--seed" && hasValue) {
+                    config.seed = static_cast<unsigned>(std::stoul(args[++i]));
+                    simulationOption = true;
+                } else if (args[i] == "--users" && hasValue) {
+                    config.users = std::stoi(args[++i]);
+                    simulationOption = true;
+                } else if (args[i] == "--resources" && hasValue) {
+                    config.resources = std::stoi(args[++i]);
+                    simulationOption = true;
+                } else if (args[i] == "--record" && hasValue) {
+                    recordFile = args[++i];
+                    simulationOption = true;
+                } else if (args[i] == "--replay" && hasValue) {
+                    replayFile = args[++i];
+                    simulate = true;
+                } else if (args[i] == "--shards" && hasValue) {
+                    shards = std::stoi(args[++i]);
+                    simulationOption = true;
+                } else if (args[i] == "--bench-codecs") {
+                    benchRecords = 200000;
+                    if (hasValue && std::isdigit(static_cast<unsigned char>(args[i + 1][0]))) benchRecords = std::stoul(args[++i]);
+                } else {
+                    throw std::invalid_argument("Unknown argument: " + args[i]);
+                }
             }
+            if (simulationOption && !simulate) {
+                throw std::invalid_argument("--seed, --users, --resources, --record and --shards need --simulate or --replay");
+            }
+            if (benchRecords > 0 && simulate) {
+                throw std::invalid_argument("--bench-codecs runs on its own, without --simulate or --replay");
+            }
+            if (benchRecords > 0 && !CodecBenchmark::run(benchRecords)) status = 1;
+            if (simulate) {
+                std::vector<CirculationSimulator::TraceOp> trace = replayFile.empty()
+                    ? CirculationSimulator::generate(config)
+                    : CirculationSimulator::load(replayFile, config);
+                if (!recordFile.empty()) CirculationSimulator::save(recordFile, config, trace);
+                if (shards > 0) {
+#if LMS_HAS_SHARDS
+                    if (!CirculationSimulator::runPartitioned(config, trace, shards)) status = 1;
+#else
+                    throw std::invalid_argument("--shards needs Unix sockets, which this platform lacks");
+#endif
+                } else {
+                    if (!CirculationSimulator::run(config, trace)) status = 1;
+                }
+            }
+        } catch (const std::exception& e) {
+            std::cout << "Error: " << e.what() << std::endl;
+            return 1;
         }
+        return status;
     }
 
-    // Notifications
-    void viewNotifications() {
-        std::cout << "\n=== Recent Notifications ===" << std::endl;
-        if (notifications.empty()) {
-            std::cout << "No notifications!" << std::endl;
-            return;
-        }
-
-        // Show last 10 notifications
-        int start = std::max(0, static_cast<int>(notifications.size()) - 10);
-        for (int i = start; i < notifications.size(); ++i) {
-            notifications[i].display();
-        }
-    }
-    void checkOverdueItems() {
-        std::cout << "\n=== Overdue Items ===" << std::endl;
-        bool found = false;
-        for (const auto& loan : loans) {
-            if (loan->isOverdue()) {
-                loan->displayInfo();
-                found = true;
-                
-                // Add overdue notification
-                int userId = loan->getUserId();
-                auto userIt = std::find_if(users.begin(), users.end(),
-                    [userId](const std::unique_ptr<User>& u) { 
-                        return u->getId() == userId; 
-                    });
-                
-                if (userIt != users.end()) {
-                    notifications.push_back(Notification(
-                        "Overdue item for " + (*userIt)->getName(), "overdue"));
-                }
-            }}}};
-            // Main function
-int main() {
     LibraryManagementSystem library;
     int choice;
     
     std::cout << "=== Library Management System ===" << std::endl;
+#if LMS_HAS_SMTP
+    // Patrons' notices are also emailed once LMS_SMTP_HOST names a server
+    if (const char* host = std::getenv("LMS_SMTP_HOST")) {
+        const char* port = std::getenv("LMS_SMTP_PORT");
+        const char* from = std::getenv("LMS_SMTP_FROM");
+        try {
+            char* end = nullptr;
+            long smtpPort = port ? std::strtol(port, &end, 10) : 25;
+            if ((port && *end != '\0') || smtpPort < 1 || smtpPort > 65535) {
+                throw std::invalid_argument("LMS_SMTP_PORT must be a port number, 1-65535");
+            }
+            std::string sender = from ? from : "library@university.edu";
+            library.startNotificationDelivery(
+                std::make_shared<SmtpSink>(host, static_cast<uint16_t>(smtpPort), sender), NotificationDispatcher::Config{});
+            std::cout << "Emailing notices through " << host << ":" << smtpPort << " from " << sender << std::endl;
+        } catch (const std::exception& e) {
+            std::cout << "Error: " << e.what() << std::endl;
+            return 1;
+        }
+    }
+#endif
     
     do {
         std::cout << "\nMain Menu:\n";
@@ -847,6 +5844,10 @@ int main() {
         std::cout << "4. Reservation System\n";
         std::cout << "5. View Notifications\n";
         std::cout << "6. Check Overdue Items\n";
+        std::cout << "7. Export Snapshot\n";
+        std::cout << "8. View Statistics\n";
+        std::cout << "9. Write Metrics File\n";
+        std::cout << "10. Write Trace File\n";
         std::cout << "0. Exit\n";
         std::cout << "Enter your choice: ";
         std::cin >> choice;
@@ -860,6 +5861,8 @@ int main() {
                 std::cout << "2. Edit Resource\n";
                 std::cout << "3. Remove Resource\n";
                 std::cout << "4. Search Resources\n";
+                std::cout << "5. Find by ISBN\n";
+                std::cout << "6. Duplicate Report\n";
                 std::cout << "0. Back to Main Menu\n";
                 std::cout << "Enter your choice: ";
                 std::cin >> resourceChoice;
@@ -869,6 +5872,8 @@ int main() {
                     case 2: library.editResource(); break;
                     case 3: library.removeResource(); break;
                     case 4: library.searchResources(); break;
+                    case 5: library.lookupResourceByIsbn(); break;
+                    case 6: library.duplicateReport(); break;
                     case 0: break;
                     default: std::cout << "Invalid choice!\n";
                 }
@@ -880,6 +5885,7 @@ int main() {
                 std::cout << "\nUser Management:\n";
                 std::cout << "1. Add User\n";
                 std::cout << "2. View All Users\n";
+                std::cout << "3. Find by Email\n";
                 std::cout << "0. Back to Main Menu\n";
                 std::cout << "Enter your choice: ";
                 std::cin >> userChoice;
@@ -887,6 +5893,7 @@ int main() {
                 switch(userChoice) {
                     case 1: library.addUser(); break;
                     case 2: library.viewUsers(); break;
+                    case 3: library.lookupUserByEmail(); break;
                     case 0: break;
                     default: std::cout << "Invalid choice!\n";
                 }
@@ -900,6 +5907,7 @@ int main() {
                 std::cout << "2. Return Resource\n";
                 std::cout << "3. Renew Resource\n";
                 std::cout << "4. View Borrow History\n";
+                std::cout << "5. Also Borrowed\n";
                 std::cout << "0. Back to Main Menu\n";
                 std::cout << "Enter your choice: ";
                 std::cin >> borrowChoice;
@@ -909,6 +5917,7 @@ int main() {
                     case 2: library.returnResource(); break;
                     case 3: library.renewResource(); break;
                     case 4: library.viewBorrowHistory(); break;
+                    case 5: library.viewAlsoBorrowed(); break;
                     case 0: break;
                     default: std::cout << "Invalid choice!\n";
                 }
@@ -938,6 +5947,18 @@ int main() {
             case 6:
                 library.checkOverdueItems();
                 break;
+            case 7:
+                library.exportSnapshot();
+                break;
+            case 8:
+                library.viewStatistics();
+                break;
+            case 9:
+                library.writeMetricsFile();
+                break;
+            case 10:
+                library.writeTraceFile();
+                break;
             case 0:
                 std::cout << "Exiting system...\n";
                 break;